@@ -0,0 +1,255 @@
+// ------------------------------------------------------------------------
+// Loopback benchmark: runs server and client in one process and reports
+// goodput, completion latency, retransmissions and CPU time as JSON.
+// ------------------------------------------------------------------------
+#include "Client.hpp"
+#include "Server.hpp"
+#include "Trace.hpp"
+#include <boost/program_options.hpp>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <sys/resource.h>
+// ------------------------------------------------------------------------
+namespace po = boost::program_options;
+namespace fs = std::filesystem;
+using namespace std;
+// ------------------------------------------------------------------------
+struct Run {
+   double p;
+   double q;
+   uint32_t repetition;
+   double wallSeconds;
+   double cpuUserSeconds;
+   double cpuSystemSeconds;
+   bool ok;
+   rft::Client::Statistics stats;
+};
+// ------------------------------------------------------------------------
+static double cpu_seconds(const timeval& tv)
+{
+   return static_cast<double>(tv.tv_sec) + static_cast<double>(tv.tv_usec) / 1e6;
+}
+// ------------------------------------------------------------------------
+static bool equal_files(const fs::path& a, const fs::path& b)
+{
+   std::error_code ec;
+   if (!fs::exists(b, ec) || fs::file_size(a) != fs::file_size(b)) return false;
+
+   ifstream fa(a, ios::binary);
+   ifstream fb(b, ios::binary);
+   return equal(istreambuf_iterator<char>(fa), istreambuf_iterator<char>(), istreambuf_iterator<char>(fb));
+}
+// ------------------------------------------------------------------------
+static double percentile(vector<double> values, double pct)
+{
+   if (values.empty()) return 0;
+   sort(values.begin(), values.end());
+   size_t idx = min(values.size() - 1, static_cast<size_t>(pct / 100 * static_cast<double>(values.size())));
+   return values[idx];
+}
+// ------------------------------------------------------------------------
+static vector<string> generate_files(const fs::path& dir, const vector<uint64_t>& sizes, uint32_t count, double compressible)
+{
+   // a fixed seed, so that runs of different builds transfer the same data
+   mt19937_64 rng(42);
+   uniform_int_distribution<int> byte(0, 255);
+   const string text = "2024-01-01 12:00:00 INFO request served from cache in 42us\n";
+
+   vector<string> files;
+   for (uint64_t size: sizes) {
+      for (uint32_t i = 0; i < count; ++i) {
+         string name = "bench_" + to_string(size) + "_" + to_string(i) + ".bin";
+         ofstream out(dir / name, ios::binary | ios::trunc);
+
+         const auto textBytes = static_cast<uint64_t>(compressible * static_cast<double>(size));
+         for (uint64_t b = 0; b < size; ++b) {
+            out.put(b < textBytes ? text[b % text.size()] : static_cast<char>(byte(rng)));
+         }
+         files.push_back(name);
+      }
+   }
+   return files;
+}
+// ------------------------------------------------------------------------
+static Run run_once(const fs::path& src, const fs::path& dst, vector<string> files, size_t port, const rft::LinkConfig& link, uint8_t capabilities, size_t cacheSize, bool zeroCopy)
+{
+   fs::remove_all(dst);
+   fs::create_directories(dst);
+
+   Run run{link.p, link.q};
+   rusage before{};
+   getrusage(RUSAGE_SELF, &before);
+   auto start = NOW;
+
+   {
+      // both directions are impaired alike, but draw from their own engines
+      rft::LinkConfig clientLink = link;
+      if (link.seed) clientLink.seed = *link.seed + 1;
+
+      rft::Server server(port, link, false, cacheSize, zeroCopy, "");
+      thread serverThread([&server]() { server.start(); });
+
+      string dest = dst.string();
+      {
+         rft::Client client("127.0.0.1", port, dest, clientLink, capabilities, false, false, "", "");
+         client.request_files(files);
+         run.stats = client.statistics();
+      }
+
+      server.stop();
+      serverThread.join();
+   }
+
+   run.wallSeconds = chrono::duration<double>(NOW - start).count();
+   rusage after{};
+   getrusage(RUSAGE_SELF, &after);
+   run.cpuUserSeconds = cpu_seconds(after.ru_utime) - cpu_seconds(before.ru_utime);
+   run.cpuSystemSeconds = cpu_seconds(after.ru_stime) - cpu_seconds(before.ru_stime);
+
+   run.ok = all_of(files.begin(), files.end(), [&](const string& f) { return equal_files(src / f, dst / f); });
+   return run;
+}
+// ------------------------------------------------------------------------
+static void print_run(ostream& out, const Run& run, uint64_t totalBytes)
+{
+   vector<double> latencies;
+   for (auto t: run.stats.completionTimes) {
+      latencies.push_back(chrono::duration<double, milli>(t).count());
+   }
+   double mean = latencies.empty() ? 0 : accumulate(latencies.begin(), latencies.end(), 0.0) / static_cast<double>(latencies.size());
+
+   out << "    {\"p\": " << run.p << ", \"q\": " << run.q << ", \"repetition\": " << run.repetition
+       << ", \"ok\": " << (run.ok ? "true" : "false")
+       << ", \"files\": " << run.stats.filesTransferred
+       << ", \"bytes\": " << totalBytes
+       << ", \"wall_s\": " << run.wallSeconds
+       << ", \"goodput_MBps\": " << static_cast<double>(totalBytes) / 1e6 / run.wallSeconds
+       << ", \"latency_ms\": {\"mean\": " << mean << ", \"p50\": " << percentile(latencies, 50) << ", \"p99\": " << percentile(latencies, 99)
+       << ", \"max\": " << percentile(latencies, 100) << "}"
+       << ", \"transmission_requests\": " << run.stats.transmissionRequests
+       << ", \"retransmission_requests\": " << run.stats.retransmissionRequests
+       << ", \"timeouts\": " << run.stats.timeouts
+       << ", \"cpu_user_s\": " << run.cpuUserSeconds
+       << ", \"cpu_sys_s\": " << run.cpuSystemSeconds << "}";
+}
+// ------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+   vector<uint64_t> sizes;
+   uint32_t count;
+   vector<double> ps;
+   vector<double> qs;
+   uint32_t repetitions;
+   size_t port;
+   string dir;
+   double compressible;
+   size_t cacheSize;
+   uint8_t capabilities = 0;
+   double delay;
+   double jitter;
+   rft::LinkConfig link;
+   uint64_t seed;
+   string traceFile;
+
+   po::options_description desc{"Usage"};
+   // clang-format off
+   desc.add_options()
+      ("help,h", "produce help message")
+      ("sizes", po::value(&sizes)->multitoken()->default_value({1 << 20}, "1048576"), "sizes of the generated files in bytes")
+      ("count", po::value(&count)->default_value(1), "number of files of every size")
+      ("p", po::value(&ps)->multitoken()->default_value({0}, "0"), "packet loss probabilities to sweep")
+      ("q", po::value(&qs)->multitoken()->default_value({1}, "1"), "packets remain lost probabilities to sweep")
+      ("delay", po::value(&delay)->default_value(0), "one-way delay in milliseconds")
+      ("jitter", po::value(&jitter)->default_value(0), "maximum random delay in milliseconds added to the one-way delay")
+      ("reorder", po::value(&link.reorder)->default_value(0), "probability a packet is held back behind the following ones")
+      ("duplicate", po::value(&link.duplicate)->default_value(0), "probability a packet is delivered twice")
+      ("bandwidth", po::value(&link.bandwidth)->default_value(0), "bytes per second of each direction, 0 is unlimited")
+      ("queue-limit", po::value(&link.queueLimit)->default_value(0), "packets waiting for the bandwidth before further ones are dropped, 0 is unlimited")
+      ("seed", po::value(&seed), "seed of the emulated links, the n-th repetition uses seed + 2n")
+      ("trace", po::value(&traceFile), "file a binary trace of all runs is written to, c.f. rft_trace")
+      ("repetitions", po::value(&repetitions)->default_value(1), "runs of every p/q combination")
+      ("compressible", po::value(&compressible)->default_value(0), "share of every file that is text instead of random bytes")
+      ("fec", "ask the server for parity chunks")
+      ("compress", "ask the server to compress chunks")
+      ("cache-size", po::value(&cacheSize)->default_value(64), "memory in MiB for the server's block cache")
+      ("zerocopy", "send cached chunks with MSG_ZEROCOPY")
+      ("t", po::value(&port)->default_value(9500), "first port to use, every run uses the next two")
+      ("dir", po::value(&dir)->default_value((fs::temp_directory_path() / "rft_bench").string()), "working directory for the generated files");
+   // clang-format on
+
+   po::variables_map vm;
+   try {
+      po::store(po::parse_command_line(argc, argv, desc), vm);
+      po::notify(vm);
+   } catch (const exception& ex) {
+      cerr << ex.what() << endl;
+      return 1;
+   }
+
+   if (vm.count("help")) {
+      cout << desc << endl;
+      return 0;
+   }
+   if (vm.count("fec")) capabilities |= rft::CAPABILITY_FEC;
+   if (vm.count("compress")) capabilities |= rft::CAPABILITY_COMPRESSION;
+   link.delay = rft::micros(static_cast<int64_t>(delay * 1000));
+   link.jitter = rft::micros(static_cast<int64_t>(jitter * 1000));
+
+   fs::path src = fs::absolute(dir) / "src";
+   fs::path dst = fs::absolute(dir) / "dst";
+   fs::create_directories(src);
+   auto files = generate_files(src, sizes, count, compressible);
+   uint64_t totalBytes = accumulate(sizes.begin(), sizes.end(), uint64_t{0}) * count;
+
+   // the server serves files relative to its working directory
+   fs::current_path(src);
+
+   if (!traceFile.empty() && !rft::trace::open(traceFile)) {
+      cerr << "Could not create trace file: " << traceFile << endl;
+      return 1;
+   }
+
+   vector<Run> runs;
+   for (double p: ps) {
+      for (double q: qs) {
+         for (uint32_t r = 0; r < repetitions; ++r) {
+            link.p = p;
+            link.q = q;
+            if (vm.count("seed")) link.seed = seed + 2 * r;
+            Run run = run_once(src, dst, files, port, link, capabilities, cacheSize * 1024 * 1024, vm.count("zerocopy"));
+            run.repetition = r;
+            runs.push_back(run);
+            // ports are not reused, delayed packets of a run must not reach the next one
+            port += 2;
+         }
+      }
+   }
+
+   rft::trace::close();
+
+   ostringstream out;
+   out << setprecision(6);
+   out << "{\n  \"config\": {\"sizes\": [";
+   for (size_t i = 0; i < sizes.size(); ++i) {
+      out << (i > 0 ? ", " : "") << sizes[i];
+   }
+   out << "], \"count\": " << count << ", \"compressible\": " << compressible
+       << ", \"fec\": " << (vm.count("fec") ? "true" : "false") << ", \"compress\": " << (vm.count("compress") ? "true" : "false")
+       << ", \"cache_size_MiB\": " << cacheSize << ", \"zerocopy\": " << (vm.count("zerocopy") ? "true" : "false") << ", \"delay_ms\": " << delay << ", \"jitter_ms\": " << jitter
+       << ", \"reorder\": " << link.reorder << ", \"duplicate\": " << link.duplicate << ", \"bandwidth\": " << link.bandwidth
+       << ", \"queue_limit\": " << link.queueLimit << ", \"seed\": " << (vm.count("seed") ? to_string(seed) : "null") << "},\n  \"runs\": [\n";
+   for (size_t i = 0; i < runs.size(); ++i) {
+      print_run(out, runs[i], totalBytes);
+      out << (i + 1 < runs.size() ? ",\n" : "\n");
+   }
+   out << "  ]\n}\n";
+   cout << out.str();
+
+   fs::remove_all(dst);
+   return all_of(runs.begin(), runs.end(), [](const Run& run) { return run.ok; }) ? 0 : 1;
+}
+// ------------------------------------------------------------------------
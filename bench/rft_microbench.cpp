@@ -0,0 +1,217 @@
+// ------------------------------------------------------------------------
+// Microbenchmarks of the primitives on the per-packet path, reporting
+// ns/op and heap allocations/op as JSON.
+// ------------------------------------------------------------------------
+#include "Bitfield.hpp"
+#include "CongestionControl.hpp"
+#include "Message.hpp"
+#include "MessageQueue.hpp"
+#include "Window.hpp"
+#include "Wire.hpp"
+#include "util.hpp"
+#include <atomic>
+#include <boost/program_options.hpp>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <thread>
+// ------------------------------------------------------------------------
+namespace po = boost::program_options;
+using namespace std;
+// ------------------------------------------------------------------------
+// every allocation of the process is counted
+static atomic<uint64_t> allocations{0};
+// ------------------------------------------------------------------------
+void* operator new(size_t size)
+{
+   allocations.fetch_add(1, memory_order_relaxed);
+   if (void* ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+   throw std::bad_alloc();
+}
+// not inlined, GCC would otherwise see free() of memory from operator new
+[[gnu::noinline]] void operator delete(void* ptr) noexcept { std::free(ptr); }
+[[gnu::noinline]] void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+// ------------------------------------------------------------------------
+/// Keeps the compiler from optimizing away a result
+template<typename T>
+static void keep(T& value)
+{
+   asm volatile("" : : "g"(&value) : "memory");
+}
+// ------------------------------------------------------------------------
+struct Result {
+   string name;
+   uint64_t iterations;
+   double nsPerOp;
+   double allocsPerOp;
+};
+// ------------------------------------------------------------------------
+/// Runs op in batches of growing size until a batch takes at least minTime
+static Result measure(const string& name, uint64_t opsPerCall, rft::millis minTime, const function<void()>& op)
+{
+   for (int i = 0; i < 16; ++i) op();
+
+   uint64_t calls = 1;
+   while (true) {
+      uint64_t allocsBefore = allocations.load();
+      auto start = chrono::steady_clock::now();
+      for (uint64_t i = 0; i < calls; ++i) op();
+      auto elapsed = chrono::steady_clock::now() - start;
+      uint64_t allocs = allocations.load() - allocsBefore;
+
+      if (elapsed >= minTime || calls >= (1ULL << 40)) {
+         const double ops = static_cast<double>(calls * opsPerCall);
+         return {name, calls * opsPerCall, static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count()) / ops, static_cast<double>(allocs) / ops};
+      }
+      calls *= 2;
+   }
+}
+// ------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+   using namespace rft;
+
+   string filter;
+   uint32_t minTimeMs;
+
+   po::options_description desc{"Usage"};
+   // clang-format off
+   desc.add_options()
+      ("help,h", "produce help message")
+      ("filter", po::value(&filter), "only run benchmarks whose name contains this string")
+      ("min-time", po::value(&minTimeMs)->default_value(200), "minimum time in milliseconds every benchmark runs");
+   // clang-format on
+
+   po::variables_map vm;
+   try {
+      po::store(po::parse_command_line(argc, argv, desc), vm);
+      po::notify(vm);
+   } catch (const exception& ex) {
+      cerr << ex.what() << endl;
+      return 1;
+   }
+   if (vm.count("help")) {
+      cout << desc << endl;
+      return 0;
+   }
+
+   const millis minTime(minTimeMs);
+   const vector<unsigned char> chunk(CHUNK_SIZE, 0xAB);
+
+   vector<pair<string, function<Result()>>> benchmarks;
+
+   benchmarks.emplace_back("Wire encode", [&]() {
+      Message<ServerMsgType> msg;
+      return measure("wire::Payload::encode (Server Data Response)", 1, minTime, [&]() {
+         wire::Payload::encode(msg, PAYLOAD, 42, 7, 64, 3, chunk);
+         keep(msg);
+      });
+   });
+
+   benchmarks.emplace_back("Wire decode", [&]() {
+      Message<ServerMsgType> msg;
+      wire::Payload::encode(msg, PAYLOAD, 42, 7, 64, 3, chunk);
+      vector<unsigned char> out(CHUNK_SIZE);
+      return measure("wire::Payload::parse (Server Data Response)", 1, minTime, [&]() {
+         auto payload = wire::Payload::parse(wire::bytes(msg));
+         std::memcpy(out.data(), payload->data.data(), payload->data.size());
+         keep(out);
+         keep(payload);
+      });
+   });
+
+   benchmarks.emplace_back("Bitfield construct", [&]() {
+      return measure("Bitfield construct (2048 bits)", 1, minTime, [&]() {
+         Bitfield bitfield(2048);
+         keep(bitfield);
+      });
+   });
+
+   benchmarks.emplace_back("Bitfield from", [&]() {
+      vector<unsigned char> payload(Bitfield::byte_size(2048), 0x5A);
+      Bitfield bitfield(2048);
+      return measure("Bitfield::from (2048 bits)", 1, minTime, [&]() {
+         bitfield.from(payload.data(), payload.size());
+         keep(bitfield);
+      });
+   });
+
+   benchmarks.emplace_back("MessageQueue contended", [&]() {
+      // two producers push while the consumer pops, as the io_context thread and the processing thread do
+      constexpr uint64_t MESSAGES = 1 << 14;
+      MessageQueue<Message<ClientMsgType>> queue;
+      Message<ClientMsgType> msg;
+      msg.header.size = 64;
+      return measure("MessageQueue push/pop (2 producers)", MESSAGES, minTime, [&]() {
+         auto produce = [&]() {
+            for (uint64_t i = 0; i < MESSAGES / 2; ++i) queue.push_back(msg);
+         };
+         thread p1(produce);
+         thread p2(produce);
+         for (uint64_t i = 0; i < MESSAGES;) {
+            if (queue.empty()) {
+               queue.wait(millis(1));
+               continue;
+            }
+            auto m = queue.pop_front();
+            keep(m);
+            ++i;
+         }
+         p1.join();
+         p2.join();
+      });
+   });
+
+   benchmarks.emplace_back("Window store_chunk", [&]() {
+      constexpr uint16_t SIZE = 64;
+      Window window(2048);
+      window.currentSize = SIZE;
+      return measure("Window::store_chunk + reset (per chunk)", SIZE, minTime, [&]() {
+         for (uint16_t i = 0; i < SIZE; ++i) {
+            window.store_chunk(chunk, i);
+         }
+         window.reset();
+         keep(window);
+      });
+   });
+
+   for (size_t size: {32, 64, 512}) {
+      benchmarks.emplace_back("compute_SHA256 " + to_string(size), [&, size]() {
+         vector<unsigned char> buffer(size, 0x11);
+         unsigned char out[SHA256_SIZE];
+         return measure("compute_SHA256 (" + to_string(size) + " B)", 1, minTime, [&]() {
+            compute_SHA256(buffer.data(), buffer.size(), out);
+            keep(out);
+         });
+      });
+   }
+
+   benchmarks.emplace_back("CongestionControl", [&]() {
+      CongestionControl cc(MAX_THROUGHPUT);
+      uint32_t rtt = 100;
+      return measure("CongestionControl::getNextWindowSize", 1, minTime, [&]() {
+         rtt = 100 + (rtt * 7 + 13) % 900;
+         uint16_t size = cc.getNextWindowSize(rtt);
+         keep(size);
+      });
+   });
+
+   ostringstream out;
+   out << setprecision(4) << fixed;
+   out << "{\n  \"benchmarks\": [\n";
+   bool first = true;
+   for (auto& [name, run]: benchmarks) {
+      if (!filter.empty() && name.find(filter) == string::npos) continue;
+      Result result = run();
+      out << (first ? "" : ",\n") << "    {\"name\": \"" << result.name << "\", \"iterations\": " << result.iterations
+          << ", \"ns_per_op\": " << result.nsPerOp << ", \"allocs_per_op\": " << result.allocsPerOp << "}";
+      first = false;
+   }
+   out << "\n  ]\n}\n";
+   cout << out.str();
+   return 0;
+}
+// ------------------------------------------------------------------------
@@ -11,35 +11,32 @@ namespace rft
    class Bitfield
    {
       // ------------------------------------------------------------------------
-      friend class Client;
-      friend class Server;
-
-      std::vector<unsigned char> bitfield;
+      /// Bits in the same order as on the wire: bit idx is bit (63 - idx % 64) of word idx / 64
+      std::vector<uint64_t> words;
       /// Number of bits in the bitfield
       uint16_t size;
 
-      class BitReference
-      {
-         friend class Bitfield;
-
-         unsigned char& byte;
-         uint16_t offset;
+    public:
+      explicit Bitfield(uint16_t size);
 
-         BitReference(unsigned char& byte, uint16_t offset);
+      /// Number of bytes needed to send the first bits of a bitfield
+      static uint16_t byte_size(uint16_t bits) { return (bits + (8 - 1)) / 8; }
 
-       public:
-         explicit operator bool() const;
-         BitReference& operator=(bool b);
-      };
+      /// Reads the bitfield from its wire format, missing bytes are treated as unset bits
+      void from(const unsigned char* payload, size_t length);
+      /// Writes the first bits of the bitfield in its wire format (byte_size(bits) bytes)
+      void to(unsigned char* payload, uint16_t bits) const;
 
-    public:
-      explicit Bitfield(uint16_t size);
+      /// Sets the bit at idx, returns false if it was already set
+      bool set(uint16_t idx);
+      void reset();
 
-      void from(std::vector<bool>& sequenceNumbers);
-      void from(unsigned char* payload);
+      /// Number of set bits
+      uint16_t count() const;
+      /// Index of the first unset bit at or after idx, or the size of the bitfield if all of them are set
+      uint16_t find_next_unset(uint16_t idx) const;
 
       bool operator[](uint16_t idx) const;
-      BitReference operator[](uint16_t idx);
    };
 }
 // ------------------------------------------------------------------------
@@ -0,0 +1,32 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_BLOCKCACHE_HPP
+#define ROBUST_FILE_TRANSFER_BLOCKCACHE_HPP
+// ------------------------------------------------------------------------
+#include "Manifest.hpp"
+#include <filesystem>
+#include <string>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Content-addressed store of the blocks of transferred files, shared by all files of the client and across runs.
+   /// A block is found by the strong checksum the server publishes in the manifest of a file, regardless of the file it came from.
+   class BlockCache
+   {
+    public:
+      explicit BlockCache(const std::string& directory);
+
+      bool contains(const Manifest::Block& block) const;
+      /// Reads a block into data, fails if the block is missing or its contents do not match its checksum
+      bool load(const Manifest::Block& block, char* data, size_t size) const;
+      /// Adds the blocks of a file that was verified against its checksum
+      void store_file(const std::string& filename, const Manifest& manifest);
+
+    private:
+      /// Blocks are spread over 256 directories by the first byte of their checksum
+      std::filesystem::path path_of(const Manifest::Block& block) const;
+
+      std::filesystem::path directory;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_BLOCKCACHE_HPP
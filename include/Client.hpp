@@ -1,13 +1,26 @@
 #ifndef ROBUST_FILE_TRANSFER_CLIENT_HPP
 #define ROBUST_FILE_TRANSFER_CLIENT_HPP
 // ------------------------------------------------------------------------
-#include "MessageQueue.hpp"
-#include "Timer.hpp"
+#include "BlockCache.hpp"
+#include "FileWriter.hpp"
+#include "Inbox.hpp"
+#include "Link.hpp"
+#include "Manifest.hpp"
+#include "Message.hpp"
+#include "Metrics.hpp"
+#include "RttEstimator.hpp"
 #include "Window.hpp"
+#include "Wire.hpp"
 #include "common.hpp"
 #include "util.hpp"
+#include <atomic>
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <unordered_map>
 // ------------------------------------------------------------------------
 namespace rft
@@ -16,47 +29,109 @@ namespace rft
    class Client
    {
       // ------------------------------------------------------------------------
-      class FileRequest
+      /// Server Initial Response that ends the handshake of a file
+      struct Handshake {
+         ConnectionID connectionId = 0;
+         uint64_t fileSize = 0;
+         wire::Hash sha256{};
+         /// Measured during the handshake, the connection starts with it
+         RttEstimator rtt;
+         /// Connection serving the manifest of the file, if it was asked for and the server announced it (c.f. CAPABILITY_MANIFEST)
+         std::shared_ptr<const Handshake> manifest;
+      };
+      // ------------------------------------------------------------------------
+      /// How the windows of a connection ended
+      enum class Outcome { COMPLETE, DISCONNECTED, CONNECTION_NOT_FOUND, WRITE_FAILED, CANCELLED };
+      // ------------------------------------------------------------------------
+      /// A received packet, passed from the receiving coroutine to its file without copying it
+      using Packet = MessagePool<Message<ServerMsgType>>::Buffer;
+      /// Packets a file has not processed yet, beyond that they are dropped. Twice the largest window, so that the packets of a window
+      /// still arrive while the previous one is written.
+      static constexpr size_t INBOX_CAPACITY = 2 * MAX_THROUGHPUT * 1024 * 1024 / CHUNK_SIZE;
+      // ------------------------------------------------------------------------
+      /// A requested file, transferred by one coroutine on its own strand (c.f. transfer_file). The receiving coroutine delivers the packets
+      /// for its handshakes and connections to its inbox on the strand.
+      class FileTransfer : public std::enable_shared_from_this<FileTransfer>
       {
          friend class Client;
 
-         explicit FileRequest(boost::asio::io_context& io_context) : timer(io_context) {}
+       public:
+         FileTransfer(std::string name, std::string dest, boost::asio::strand<boost::asio::io_context::executor_type> strand)
+             : name(std::move(name)), dest(std::move(dest)), strand(strand), timer(strand)
+         {
+         }
 
-         uint32_t nonce = 0;
-         unsigned char hash1Solution[SHA256_SIZE]{'\0'};
-         Timer timer;
-         timepoint tp;
-         uint8_t retryCounter = 1;
-         const uint8_t maxRetries = 10;
+       private:
+         /// Resumes the coroutine if it waits, runs on the strand
+         void wake();
+
+         /// Name of the file on the server
+         const std::string name;
+         /// Path of the file at the destination
+         const std::string dest;
+         boost::asio::strand<boost::asio::io_context::executor_type> strand;
+         Inbox<Message<ServerMsgType>> inbox{INBOX_CAPACITY};
+         /// Resumes the coroutine waiting for the inbox, set while it waits
+         std::function<void()> waiter;
+         /// Expires at or before the deadline of the coroutine. A later deadline is not armed until the timer expired, so that the timer is
+         /// armed about once per timeout instead of for every packet (c.f. TimerWheel).
+         boost::asio::high_resolution_timer timer;
+         /// Expiry of the pending wait of the timer, max if none is pending
+         timepoint armed = timepoint::max();
+
+         /// Copies of the state of the current connection for the metrics, which are written on another strand
+         std::atomic<bool> connected = false;
+         std::atomic<ConnectionID> connectionId = 0;
+         std::atomic<uint16_t> windowSize = 0;
+         std::atomic<int64_t> srtt = 0;
+         std::atomic<int64_t> rto = 0;
+         std::atomic<uint16_t> chunksLost = 0;
+         std::atomic<uint64_t> fileSize = 0;
+         std::atomic<uint64_t> bytesWritten = 0;
       };
       // ------------------------------------------------------------------------
+      /// Connection of a file transfer, either to the file itself or to its manifest
       class Connection
       {
          friend class Client;
-         Connection(std::string& filename, uint64_t fileSize, unsigned char sha256[SHA256_SIZE], Window window, boost::asio::io_context& io_context)
-             : filename(std::move(filename)), fileSize(fileSize), window(std::move(window)), timer(io_context)
-         {
-            std::memcpy(this->sha256, sha256, SHA256_SIZE);
-            file.open(this->filename, std::ios::binary | std::ios::trunc);
-            if (!file) {
-               PLOG_ERROR << "[Client] Could not open file for writing.";
-               throw std::system_error();
-            }
-         }
 
+       public:
+         Connection(std::string filename, const Handshake& handshake, bool directIo)
+             : filename(std::move(filename)), file(this->filename, handshake.fileSize, directIo), connectionId(handshake.connectionId), fileSize(handshake.fileSize),
+               sha256(handshake.sha256), rtt(handshake.rtt)
+         {}
+
+       private:
          std::string filename;
-         std::ofstream file;
+         FileWriter file;
+         ConnectionID connectionId;
          uint64_t fileSize = 0;
-         uint32_t bytesWritten = 0;
+         uint64_t bytesWritten = 0;
          uint32_t chunksWritten = 0;
-         unsigned char sha256[SHA256_SIZE]{'\0'};
-         Window window;
+         wire::Hash sha256;
+         Window window{MAX_THROUGHPUT * 1024 * 1024 / CHUNK_SIZE};
 
-         Timer timer;
          timepoint tp;
+         /// Inherited from the handshake, a resumed connection keeps its own
+         RttEstimator rtt;
          bool shouldMeasureTime = true;
+         /// Chunks of the last window that did not arrive with its first transmission, reported to size the parity
+         uint16_t chunksLost = 0;
          uint8_t retryCounter = 1;
          const uint8_t maxRetries = 10;
+         /// Chunks the server may send in the next window, 0 places no limit
+         uint32_t windowLimit = 0;
+
+         /// The connection transfers the manifest of another connection's file
+         bool isManifest = false;
+         /// Local copy of an older version of the file that blocks are copied from, empty if there is none
+         std::string basis;
+         /// Empty if the file is transferred as a whole
+         Manifest manifest;
+         /// Offset of every block of the file in the basis, -1 for blocks that have to be transferred and BLOCK_CACHED for blocks of the BlockCache
+         std::vector<int64_t> blockOffsets;
+         static constexpr int64_t BLOCK_CACHED = -2;
+         uint64_t bytesCopied = 0;
 
          bool isFileTransferComplete() const
          {
@@ -66,81 +141,193 @@ namespace rft
       // ------------------------------------------------------------------------
 
     public:
-      Client(std::string host, size_t port, std::string& fileDest, double p, double q);
+      /// Counters of a client's transfers, e.g., for benchmarks
+      struct Statistics {
+         uint64_t filesTransferred = 0;
+         /// Bytes of file contents that arrived over the network
+         uint64_t bytesReceived = 0;
+         /// Bytes of file contents copied from local copies (c.f. Manifest)
+         uint64_t bytesCopied = 0;
+         uint64_t transmissionRequests = 0;
+         uint64_t retransmissionRequests = 0;
+         /// Expired timeouts of file requests and connections
+         uint64_t timeouts = 0;
+         /// Time from request_files() until each file was verified
+         std::vector<timeunit> completionTimes;
+      };
+
+      /// Progress of a file, reported after every window that was written and once the file was verified
+      struct Progress {
+         /// Path of the file at the destination
+         std::string file;
+         /// Bytes at the destination, including those copied from local copies
+         uint64_t bytes = 0;
+         uint64_t fileSize = 0;
+         bool complete = false;
+      };
+      using ProgressHandler = std::function<void(const Progress&)>;
+
+      /// The metrics are written to metricsFile every METRICS_INTERVAL and once all files were transferred, unless it is empty
+      Client(std::string host, size_t port, std::string& fileDest, const LinkConfig& link, uint8_t capabilities, bool useDelta, bool directIo, const std::string& cacheDir,
+             const std::string& metricsFile);
+      /// A client embedded into a service: its socket is bound to an ephemeral port and runs on the service's io_context, which has to run until
+      /// the client is destroyed. SIGINT is left to the service.
+      Client(boost::asio::io_context& context, const boost::asio::ip::udp::endpoint& server, std::string fileDest, const LinkConfig& link, uint8_t capabilities,
+             bool useDelta, bool directIo, const std::string& cacheDir, const std::string& metricsFile);
       Client(const Client& other) = delete;
       Client(const Client&& other) = delete;
       ~Client();
 
+      /// Starts to transfer the files on the io_context, every file in a coroutine of its own. done is called once all files were transferred,
+      /// given up on or the transfer was cancelled.
+      void start(std::vector<std::string> files, std::function<void()> done);
+      /// Returns once all files were transferred, given up on or the transfer was cancelled. A client with its own io_context runs it on
+      /// hardware_concurrency() threads until then.
       void request_files(std::vector<std::string>& files);
+      /// Complete once the done handler of start() was called
+      const Statistics& statistics() const { return stats; }
+      /// Called on the strands of the files, concurrently for different files, set before start()
+      void on_progress(ProgressHandler handler) { progressHandler = std::move(handler); }
+      /// Stops the transfers and deletes the incomplete files, can be called from any thread
+      void cancel();
+      bool isCancelled() const { return cancelled; }
 
     private:
-      void resolve_server();
-      void start();
-      void stop();
-
-      void request_file(std::string filename);
+      /// Keeps the client alive while an operation on its io_context is pending, i.e., its handler or coroutine has not been destroyed yet
+      class PendingIo
+      {
+       public:
+         /// Signals idle once the last pending operation is destroyed
+         struct Count {
+            std::atomic<size_t> value = 0;
+            std::mutex mux;
+            std::condition_variable idle;
+         };
 
-      static void handle_user_termination();
-      void delete_incomplete_files();
+         explicit PendingIo(Count& count) : count(&count) { ++count.value; }
+         PendingIo(const PendingIo& other) : count(other.count) { ++count->value; }
+         PendingIo& operator=(const PendingIo& other) = delete;
+         ~PendingIo()
+         {
+            if (--count->value == 0) {
+               // a waiter that saw a pending operation waits under the lock, it cannot miss the notification
+               std::lock_guard lock(count->mux);
+               count->idle.notify_all();
+            }
+         }
 
-      void process_msgs();
+       private:
+         Count* count;
+      };
 
-      void dispatch_msg(Message<ServerMsgType>& msg);
+      void resolve_server();
+      void stop();
+      /// Closes the socket and stops the metrics once the last file is done
+      void finish();
 
       void send_msg(Message<ClientMsgType> msg);
-      void receive_msg();
-
-      void handle_receive(const boost::system::error_code& error, size_t bytes_transferred);
-      void handle_send(const boost::system::error_code& error, size_t bytes_transferred);
+      /// Receives every packet and delivers it to the inbox of the file it belongs to, runs on the strand of the socket
+      boost::asio::awaitable<void> receive_packets();
+      void deliver(Packet msg);
+      /// Waits for the next packet of the file until the deadline, nothing once it expired or the transfer was cancelled
+      boost::asio::awaitable<Packet> receive(FileTransfer& transfer, timepoint deadline);
 
-      void enqueue_msg(size_t bytes_transferred);
-      void decode_msg(size_t bytes_transferred);
+      /// Transfers a file: handshake, manifest, windows, verification, and resumption of its connection
+      boost::asio::awaitable<void> transfer_file(std::shared_ptr<FileTransfer> transfer);
+      /// File Request, Validation Response and Server Initial Response, with manifest the Server Manifest Response is collected as well
+      boost::asio::awaitable<std::optional<Handshake>> handshake(FileTransfer& transfer, bool manifest);
+      static wire::Hash solve_puzzle(uint8_t difficulty, const wire::Hash& hash1, const wire::Hash& hash2);
+      /// Transfers the manifest of a file on the connection announced during its handshake and matches it against its basis and the cache,
+      /// the file is transferred as a whole if that fails
+      boost::asio::awaitable<void> fetch_manifest(FileTransfer& transfer, Connection& conn, const Handshake& offer);
+      /// Receives the windows of a connection until its file is complete
+      boost::asio::awaitable<Outcome> receive_windows(FileTransfer& transfer, Connection& conn);
+      /// Compares the checksum of the bytes written for a complete connection with the one of the server
+      static bool verify(Connection& conn);
+      /// Removes the incomplete file of a connection and puts the local copy it was built from back in place
+      void discard(Connection& conn);
 
-      void handle_validation_request(Message<ServerMsgType>& msg);
-      void handle_initial_response(Message<ServerMsgType>& msg);
-      void handle_payload_packet(Message<ServerMsgType>& msg);
-      void handle_validation_failed(Message<ServerMsgType>& msg);
-      void handle_file_not_found(Message<ServerMsgType>& msg);
-      void handle_connection_not_found(Message<ServerMsgType>& msg);
+      /// Stores a packet of the current window, false if it belongs to another connection or window
+      bool store_payload(Connection& conn, const Message<ServerMsgType>& msg);
+      bool store_compressed(Connection& conn, const Message<ServerMsgType>& msg);
+      bool store_parity(Connection& conn, const Message<ServerMsgType>& msg);
+      /// Measures the RTT for a packet of the current window
+      void track_window_response(Connection& conn, timepoint end);
+      /// Writes a complete window, runs on the workers
+      bool write_window(Connection& conn);
+      /// Copies the blocks that are present in the basis up to the next block that is transferred, runs on the workers
+      bool copy_blocks(Connection& conn);
+      /// Runs blocking work on the workers, the calling coroutine is resumed on its strand once it is done
+      template<typename Function>
+      boost::asio::awaitable<std::invoke_result_t<Function&>> offload(Function function);
 
-      void handle_file_request_timeout(std::string& filename);
-      void handle_validation_response_timeout(std::string& filename);
-      void handle_transmission_timeout(ConnectionID connectionId);
-      void handle_retransmission_timeout(ConnectionID connectionId);
-
-      void request_transmission(ConnectionID connectionId);
-      void request_retransmission(ConnectionID connectionId);
+      void request_transmission(Connection& conn);
+      void request_retransmission(Connection& conn);
       void send_finish_msg(ConnectionID connectionId);
+      void report_progress(const Connection& conn, bool complete);
+      /// Publishes the state of a connection for the metrics
+      void publish(FileTransfer& transfer, const Connection& conn);
+      void register_connection(FileTransfer& transfer, ConnectionID connectionId);
+      void unregister_connection(FileTransfer& transfer, ConnectionID connectionId);
+      boost::asio::awaitable<void> export_metrics_periodically();
+      /// Writes the counters and the state of every connection, runs on the strand of the metrics
+      void export_metrics();
 
-      boost::asio::io_context io_context;
+      /// Outlives the io_context, its destructor destroys the handlers of pending operations
+      PendingIo::Count pendingIo;
+      /// Outlives the packets, which are held by the inboxes and by the handlers of pending operations
+      MessagePool<Message<ServerMsgType>> packets;
+      /// Empty if the client runs on the io_context of the service it is embedded into
+      std::unique_ptr<boost::asio::io_context> ownContext;
+      boost::asio::io_context& io_context;
+      /// Operates on a strand, the io_context may be run by several threads
       boost::asio::ip::udp::socket socket;
-      std::thread thread_context;
+      Link link;
+      /// Disk writes, checksums and the puzzles of the handshakes, which are moved off the io_context
+      boost::asio::thread_pool workers;
       std::string host;
       size_t port;
       boost::asio::ip::udp::endpoint server_endpoint;
       boost::asio::ip::udp::endpoint remote_endpoint;
 
       std::string fileDest;
-      std::unordered_map<ConnectionID, Connection> connections;
-      std::unordered_map<std::string, FileRequest> fileRequests;
-
-      /// A constant that is multiplied to the average rtt
-      /// E.g. setting the timeout to be 10 times longer than the average rtt
-      const size_t TIMEOUT = 10;
-      uint32_t rttTotal = 0;
-      size_t rttCount = 1;
-      uint32_t rttCurrent = 0;
-
-      Message<ServerMsgType> msgIn{};
-      MessageQueue<Message<ServerMsgType>> msgQueue;
-
-      bool done = false;
+      /// Optional features the server is asked for (c.f. Capability)
+      uint8_t capabilities;
+      /// Files that exist at the destination are updated by transferring only the blocks that changed
+      bool useDelta;
+      /// Received files bypass the page cache (c.f. FileWriter)
+      bool directIo;
+      /// Blocks of all files that were transferred before, fetched by the checksums of a manifest
+      std::optional<BlockCache> cache;
+      std::mutex cacheMutex;
 
-      static std::sig_atomic_t abort;
+      /// Routes the packets of the handshakes by filename and the packets of the connections by their ID
+      std::mutex transfersMutex;
+      std::unordered_map<std::string, std::shared_ptr<FileTransfer>> transfers;
+      std::unordered_map<ConnectionID, std::shared_ptr<FileTransfer>> connections;
+      /// Files whose coroutine has not returned yet
+      std::atomic<size_t> remaining = 0;
+      std::function<void()> onDone;
+      /// SIGINT cancels a client with its own io_context
+      std::optional<boost::asio::signal_set> signals;
 
-      PacketLossState packetLossState = PacketLossState::NOT_LOST;
-      double p;
-      double q;
+      std::atomic<bool> cancelled = false;
+      ProgressHandler progressHandler;
+      timepoint started;
+      std::mutex statsMutex;
+      Statistics stats;
+      /// Packets are sent from the strands of the files, and received on the strand of the socket
+      std::atomic<uint64_t> packetsSent = 0;
+      std::atomic<uint64_t> bytesSent = 0;
+      std::atomic<uint64_t> packetsReceived = 0;
+      std::atomic<uint64_t> bytesReceived = 0;
+      /// Received packets waiting in the inboxes
+      std::atomic<size_t> queued = 0;
+      /// Time from the first File Request until the Server Initial Response
+      Histogram handshakeLatency{HANDSHAKE_BUCKETS};
+      std::string metricsFile;
+      boost::asio::steady_timer metricsTimer;
+      bool metricsStopped = false;
    };
 }
 // ------------------------------------------------------------------------
@@ -0,0 +1,30 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_COMPRESSION_HPP
+#define ROBUST_FILE_TRANSFER_COMPRESSION_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include <optional>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Byte-oriented LZ77 codec for Server Compressed Data Responses.
+   /// A control byte c < 0x80 is followed by c + 1 literals, otherwise it encodes a match of (c & 0x7F) + 4 bytes
+   /// at the 16 bit big-endian distance that follows. Every packet is an independent stream.
+   namespace lz
+   {
+      /// Chunks whose bytes are spread more evenly (e.g. already compressed data) are not worth compressing
+      const double MAX_ENTROPY = 7.0;
+
+      /// Order-0 entropy check that is cheaper than trying to compress the data
+      bool is_compressible(const unsigned char* data, size_t size);
+
+      /// Compresses whole chunks (CHUNK_SIZE bytes, the last one may be shorter) as long as the output fits into capacity.
+      /// Returns the number of input bytes that were compressed, outSize is set to the size of the output.
+      size_t compress_chunks(const unsigned char* in, size_t size, unsigned char* out, size_t capacity, size_t& outSize);
+
+      /// Returns the size of the decompressed data or nothing if the input is malformed or does not fit into capacity
+      std::optional<size_t> decompress(const unsigned char* in, size_t size, unsigned char* out, size_t capacity);
+   }// namespace lz
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_COMPRESSION_HPP
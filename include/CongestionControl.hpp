@@ -10,22 +10,25 @@ namespace rft
    {
       friend class Server;
 
+    public:
+      explicit CongestionControl(uint16_t maxThroughput) : maxThroughput(maxThroughput) {}
+
+      /// Size of the next window of a connection from the RTT the client measured during the last one
+      uint16_t getNextWindowSize(uint32_t rrt);
+
+    private:
       enum class Phase
       {
          CC_NORMAL,
          CC_AVOIDANCE
       };
 
-      explicit CongestionControl(uint16_t maxThroughput) : maxThroughput(maxThroughput) {}
-
       Phase phase = Phase::CC_NORMAL;
       const double BETA = 0.5;
       uint32_t rttMax = 0;
       uint32_t rttCurrent = 0;
       uint16_t maxThroughput;
       uint16_t cwnd = 1;
-
-      uint16_t getNextWindowSize(uint32_t rrt);
    };
 }// namespace rft
 // ------------------------------------------------------------------------
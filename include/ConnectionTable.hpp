@@ -0,0 +1,146 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_CONNECTIONTABLE_HPP
+#define ROBUST_FILE_TRANSFER_CONNECTIONTABLE_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include <array>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Slot array of connections addressed by IDs consisting of the slot index (low bits) and the slot's generation (high bits).
+   /// The generation is increased whenever a slot is freed, hence IDs of finished connections do not match a reused slot.
+   /// Lookups are lock-free, insertion and removal are serialized.
+   /// A connection must only be erased by the thread that processes its messages, since readers do not keep it alive.
+   template<typename T>
+   class ConnectionTable
+   {
+    public:
+      static constexpr uint8_t INDEX_BITS = 20;
+      static constexpr uint32_t MAX_SLOTS = 1U << INDEX_BITS;
+      static constexpr uint32_t GENERATION_MASK = (1U << (32 - INDEX_BITS)) - 1;
+      /// Slots are allocated in segments that never move, so a lookup needs no lock
+      static constexpr uint32_t SEGMENT_SIZE = 1024;
+      /// Freed slots are only reused once this many are free: reuse is spread over the slots and generations wrap slowly
+      static constexpr uint32_t MIN_FREE_SLOTS = 1024;
+
+      ConnectionTable() = default;
+      ConnectionTable(const ConnectionTable& other) = delete;
+      ConnectionTable(const ConnectionTable&& other) = delete;
+      ~ConnectionTable()
+      {
+         for (auto& segment: segments) {
+            delete[] segment.load();
+         }
+      }
+
+      /// Constructs a connection in a free slot and returns its ID, or nothing if the table is full
+      template<typename... Args>
+      std::optional<ConnectionID> emplace(Args&&... args)
+      {
+         std::unique_lock lock(mux);
+
+         uint32_t idx;
+         uint32_t slots = slotCount.load(std::memory_order_relaxed);
+         if (freeSlots.size() > MIN_FREE_SLOTS || (slots == MAX_SLOTS && !freeSlots.empty())) {
+            idx = freeSlots.front();
+            freeSlots.pop_front();
+         } else if (slots < MAX_SLOTS) {
+            idx = slots;
+            if (idx % SEGMENT_SIZE == 0) {
+               segments[idx / SEGMENT_SIZE].store(new Slot[SEGMENT_SIZE], std::memory_order_release);
+            }
+            slotCount.store(slots + 1, std::memory_order_release);
+         } else {
+            return std::nullopt;
+         }
+
+         Slot& slot = at(idx);
+         slot.value.emplace(std::forward<Args>(args)...);
+
+         ConnectionID connectionId = (slot.generation << INDEX_BITS) | idx;
+         slot.tag.store(OCCUPIED | connectionId, std::memory_order_release);
+         ++count;
+
+         return connectionId;
+      }
+
+      /// Returns the connection with the given ID or nullptr if the ID is unknown or belongs to a finished connection
+      T* find(ConnectionID connectionId)
+      {
+         uint32_t idx = connectionId & (MAX_SLOTS - 1);
+         if (idx >= slotCount.load(std::memory_order_acquire)) return nullptr;
+
+         Slot& slot = at(idx);
+         if (slot.tag.load(std::memory_order_acquire) != (OCCUPIED | connectionId)) return nullptr;
+
+         return &*slot.value;
+      }
+
+      bool erase(ConnectionID connectionId)
+      {
+         std::unique_lock lock(mux);
+
+         uint32_t idx = connectionId & (MAX_SLOTS - 1);
+         if (idx >= slotCount.load(std::memory_order_relaxed)) return false;
+
+         Slot& slot = at(idx);
+         if (slot.tag.load(std::memory_order_relaxed) != (OCCUPIED | connectionId)) return false;
+
+         slot.tag.store(0, std::memory_order_release);
+         slot.value.reset();
+         // generation 0 is skipped so that an ID of 0 never refers to a connection
+         slot.generation = std::max<uint32_t>((slot.generation + 1) & GENERATION_MASK, 1);
+         freeSlots.push_back(idx);
+         --count;
+
+         return true;
+      }
+
+      size_t size() const
+      {
+         return count;
+      }
+
+      /// Calls f with the ID and the connection of every occupied slot, insertion and removal wait meanwhile
+      template<typename F>
+      void for_each(F f)
+      {
+         std::unique_lock lock(mux);
+
+         const uint32_t slots = slotCount.load(std::memory_order_relaxed);
+         for (uint32_t idx = 0; idx < slots; ++idx) {
+            Slot& slot = at(idx);
+            const uint64_t tag = slot.tag.load(std::memory_order_relaxed);
+            if (tag & OCCUPIED) f(static_cast<ConnectionID>(tag), *slot.value);
+         }
+      }
+
+    private:
+      static constexpr uint64_t OCCUPIED = 1ULL << 32;
+
+      struct Slot {
+         /// OCCUPIED | ID of the connection in this slot, 0 if the slot is free
+         std::atomic<uint64_t> tag = 0;
+         uint32_t generation = 1;
+         std::optional<T> value;
+      };
+
+      Slot& at(uint32_t idx)
+      {
+         return segments[idx / SEGMENT_SIZE].load(std::memory_order_acquire)[idx % SEGMENT_SIZE];
+      }
+
+      std::array<std::atomic<Slot*>, MAX_SLOTS / SEGMENT_SIZE> segments{};
+      std::atomic<uint32_t> slotCount = 0;
+      std::atomic<size_t> count = 0;
+      std::deque<uint32_t> freeSlots;
+      std::mutex mux;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_CONNECTIONTABLE_HPP
@@ -0,0 +1,60 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_DIFFICULTYCONTROL_HPP
+#define ROBUST_FILE_TRANSFER_DIFFICULTYCONTROL_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include <ctime>
+#include <map>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Chooses the number of masked bits of the client validation puzzle from the current server load
+   class DifficultyControl
+   {
+      friend class Server;
+
+      explicit DifficultyControl(bool useReputation) : useReputation(useReputation) {}
+
+      /// Difficulty under normal load, solving the puzzle is near-free
+      const uint8_t MIN_DIFFICULTY = 4;
+      /// Upper bound of the difficulty, 2^22 trials keep a client busy for a few seconds
+      const uint8_t MAX_DIFFICULTY = 22;
+      /// Interval in which handshake rate and CPU usage are measured
+      const millis INTERVAL = millis(1000);
+      /// File requests per second the server handles without raising the difficulty
+      const double NORMAL_HANDSHAKE_RATE = 100;
+      /// Number of messages waiting to be processed that is considered normal
+      const double NORMAL_QUEUE_DEPTH = 256;
+      /// Number of validation responses waiting for the worker that is considered normal
+      const double NORMAL_PENDING_VALIDATIONS = 8;
+      /// Share of the server threads' CPU time from which on the difficulty is raised
+      const double CPU_THRESHOLD = 0.7;
+      /// Number of bits added when the server threads are fully busy
+      const uint8_t MAX_CPU_BITS = 6;
+      /// File requests per interval a single source may send without being penalized
+      const double NORMAL_SOURCE_REQUESTS = 8;
+      /// Maximum number of tracked sources (a spoofed flood would otherwise grow the map without bound)
+      const size_t MAX_SOURCES = 1 << 16;
+      /// Number of threads processing messages on the server (main thread and io_context thread)
+      const double SERVER_THREADS = 2;
+
+      bool useReputation;
+
+      timepoint intervalStart = NOW;
+      std::clock_t cpuStart = std::clock();
+      uint32_t handshakes = 0;
+      double handshakeRate = 0;
+      double cpuUsage = 0;
+      uint8_t difficulty = MIN_DIFFICULTY;
+
+      /// Number of file requests per source, halved at the end of every interval
+      std::map<ip::address, double> sources;
+
+      uint8_t getDifficulty(const ip::address& source, size_t queueDepth, size_t pendingValidations);
+
+      void measure_load();
+      uint8_t reputation_bits(const ip::address& source);
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_DIFFICULTYCONTROL_HPP
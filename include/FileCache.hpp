@@ -0,0 +1,70 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_FILECACHE_HPP
+#define ROBUST_FILE_TRANSFER_FILECACHE_HPP
+// ------------------------------------------------------------------------
+#include "ReadCache.hpp"
+#include "Wire.hpp"
+#include "common.hpp"
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Files served by the server, opened, stat'ed and hashed once for all connections transferring them. An entry is replaced as soon as
+   /// the file at its path changes, the least recently opened entry is closed once the capacity is exceeded.
+   class FileCache
+   {
+    public:
+      /// An open regular file, it stays open while a connection holds it, even after it was evicted or replaced
+      class File
+      {
+       public:
+         File(int fd, const ReadCache::FileId& id) : fd(fd), id(id) {}
+         File(const File& other) = delete;
+         ~File();
+
+         /// Opens a regular file without caching it, returns nullptr if it cannot be opened
+         static std::shared_ptr<const File> open(const std::string& path);
+
+         uint64_t size() const { return id.size; }
+         /// Reads up to size bytes at offset from any thread, returns the number of bytes read
+         size_t read(uint64_t offset, unsigned char* buffer, size_t size) const;
+         /// Computed on the first call, concurrent callers wait for it
+         const wire::Hash& sha256() const;
+         /// The file's manifest in its wire format, an unlinked file that is created on the first call like sha256(). nullptr if it
+         /// could not be created.
+         const std::shared_ptr<const File>& manifest() const;
+
+         const int fd;
+         /// Identity of the contents when the file was opened
+         const ReadCache::FileId id;
+
+       private:
+         mutable std::once_flag hashOnce;
+         mutable wire::Hash hash{};
+         mutable std::once_flag manifestOnce;
+         mutable std::shared_ptr<const File> manifestFile;
+      };
+
+      explicit FileCache(size_t capacity) : capacity(capacity) {}
+      FileCache(const FileCache& other) = delete;
+
+      /// Returns the file at path, which is opened again if it was modified or replaced since it was cached, or nullptr if it is not a
+      /// regular file. Can be called from any thread.
+      std::shared_ptr<const File> open(const std::string& path);
+
+      size_t size() const;
+
+    private:
+      mutable std::mutex mux;
+      /// Most recently opened file at the front
+      std::list<std::pair<std::string, std::shared_ptr<const File>>> lru;
+      std::unordered_map<std::string, decltype(lru)::iterator> files;
+      size_t capacity;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_FILECACHE_HPP
@@ -0,0 +1,55 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_FILEWRITER_HPP
+#define ROBUST_FILE_TRANSFER_FILEWRITER_HPP
+// ------------------------------------------------------------------------
+#include "Wire.hpp"
+#include "common.hpp"
+#include <memory>
+#include <string>
+// ------------------------------------------------------------------------
+class SHA256;
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Writes a received file front to back. The file is allocated with its final size up front, so that it does not fragment while it
+   /// grows, and the bytes are collected in an aligned buffer that is written once it is full. With direct, the buffers bypass the page
+   /// cache (O_DIRECT), falling back to buffered writes where the file system does not support it. The checksum is computed on the way,
+   /// the file is not read back.
+   class FileWriter
+   {
+    public:
+      /// Bytes written at once, a multiple of the alignment O_DIRECT requires
+      static constexpr size_t BUFFER_SIZE = 1 << 20;
+      static constexpr size_t ALIGNMENT = 4096;
+
+      FileWriter(const std::string& filename, uint64_t size, bool direct);
+      FileWriter(const FileWriter& other) = delete;
+      /// Bytes that were not written by close() are lost
+      ~FileWriter();
+
+      /// False if the file could not be created or allocated, or a write failed
+      explicit operator bool() const { return fd >= 0 && !failed; }
+
+      bool write(const void* data, size_t size);
+      /// Writes the remaining bytes and truncates the file to the bytes written, with sync the file is synced to disk once. Run off the
+      /// io_context, like the writes.
+      bool close(bool sync);
+      /// SHA-256 of the bytes written so far
+      wire::Hash sha256();
+
+    private:
+      bool flush();
+
+      int fd = -1;
+      bool direct;
+      bool failed = false;
+      /// Offset of the buffer in the file
+      uint64_t offset = 0;
+      std::unique_ptr<unsigned char, void (*)(void*)> buffer;
+      size_t capacity;
+      size_t used = 0;
+      std::unique_ptr<SHA256> hash;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_FILEWRITER_HPP
@@ -0,0 +1,126 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_INBOX_HPP
+#define ROBUST_FILE_TRANSFER_INBOX_HPP
+// ------------------------------------------------------------------------
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Buffers of received messages, which return to the pool once their receiver destroys them, so that receiving does not allocate.
+   /// The pool has to outlive its buffers. Can be used from any thread.
+   template<typename Message>
+   class MessagePool
+   {
+      struct Recycle {
+         MessagePool* pool = nullptr;
+         void operator()(Message* msg) const { pool->recycle(msg); }
+      };
+
+    public:
+      using Buffer = std::unique_ptr<Message, Recycle>;
+
+      MessagePool() = default;
+      MessagePool(const MessagePool& other) = delete;
+      ~MessagePool()
+      {
+         for (Message* msg: free) delete msg;
+      }
+
+      Buffer acquire()
+      {
+         {
+            std::lock_guard lock(mux);
+            if (!free.empty()) {
+               Message* msg = free.back();
+               free.pop_back();
+               return Buffer(msg, Recycle{this});
+            }
+         }
+         return Buffer(new Message{}, Recycle{this});
+      }
+
+    private:
+      void recycle(Message* msg)
+      {
+         std::lock_guard lock(mux);
+         free.push_back(msg);
+      }
+
+      std::mutex mux;
+      std::vector<Message*> free;
+   };
+   // ------------------------------------------------------------------------
+   /// Messages passed from one producer to one consumer, which waits for them on its own. A ring that grows up to its capacity, a message
+   /// that arrives at a full inbox is dropped like by a full socket buffer. The consumer marks itself waiting when it finds the inbox
+   /// empty, so that the producer only wakes it then, instead of for every message.
+   template<typename Message>
+   class Inbox
+   {
+    public:
+      using Buffer = typename MessagePool<Message>::Buffer;
+
+      enum class Pushed
+      {
+         DROPPED,
+         QUEUED,
+         /// The consumer found the inbox empty, the producer has to wake it
+         WAKE
+      };
+
+      explicit Inbox(size_t capacity) : capacity(capacity) {}
+      Inbox(const Inbox& other) = delete;
+
+      /// Takes msg unless the inbox is full
+      Pushed push(Buffer& msg)
+      {
+         std::lock_guard lock(mux);
+         if (count == slots.size()) {
+            if (count == capacity) return Pushed::DROPPED;
+            grow();
+         }
+         slots[(head + count) % slots.size()] = std::move(msg);
+         ++count;
+
+         if (!waiting) return Pushed::QUEUED;
+         waiting = false;
+         return Pushed::WAKE;
+      }
+
+      /// The oldest message, or an empty buffer after which the consumer waits to be woken
+      Buffer pop()
+      {
+         std::lock_guard lock(mux);
+         if (count == 0) {
+            waiting = true;
+            return {};
+         }
+         Buffer msg = std::move(slots[head]);
+         head = (head + 1) % slots.size();
+         --count;
+         return msg;
+      }
+
+    private:
+      void grow()
+      {
+         std::vector<Buffer> grown(std::clamp<size_t>(2 * slots.size(), 16, capacity));
+         for (size_t i = 0; i < count; ++i) {
+            grown[i] = std::move(slots[(head + i) % slots.size()]);
+         }
+         slots = std::move(grown);
+         head = 0;
+      }
+
+      std::mutex mux;
+      std::vector<Buffer> slots;
+      size_t head = 0;
+      size_t count = 0;
+      size_t capacity;
+      bool waiting = false;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_INBOX_HPP
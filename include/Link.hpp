@@ -0,0 +1,159 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_LINK_HPP
+#define ROBUST_FILE_TRANSFER_LINK_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include "util.hpp"
+#include <array>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <span>
+#include <vector>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Impairments of the emulated link in the direction a side sends to
+   struct LinkConfig {
+      /// Gilbert-Elliott loss: probability to lose a packet after one got through, and to keep losing after a loss
+      double p = 0;
+      double q = 1;
+      /// One-way delay and the maximum random delay added to it
+      micros delay{0};
+      micros jitter{0};
+      /// Probability a packet is held back behind the following ones
+      double reorder = 0;
+      /// Probability a packet is delivered twice
+      double duplicate = 0;
+      /// Bytes per second, 0 is unlimited
+      uint64_t bandwidth = 0;
+      /// Packets waiting for the bandwidth, further ones are dropped, 0 is unlimited
+      size_t queueLimit = 0;
+      /// All decisions of the link are reproducible with a seed
+      std::optional<uint64_t> seed;
+
+      /// Whether packets can be delayed, otherwise they are sent immediately or dropped
+      bool delays() const { return delay.count() > 0 || jitter.count() > 0 || reorder > 0 || duplicate > 0 || bandwidth > 0; }
+   };
+   // ------------------------------------------------------------------------
+   /// Emulated link layer between the protocol and the socket. Every packet passes through it on the sending side,
+   /// delayed packets are sent from the io_context of the socket.
+   class Link
+   {
+    public:
+      /// The fate of a packet: how many copies arrive, and after which delay
+      struct Schedule {
+         uint8_t copies = 0;
+         micros delay[2]{};
+      };
+
+      /// Sends that referenced their payload, c.f. enable_zerocopy()
+      struct ZeroCopyStats {
+         uint64_t sent = 0;
+         /// Sends the kernel copied nevertheless, e.g., over the loopback device
+         uint64_t copied = 0;
+         /// Sends the kernel refused to pin the payload for, which were copied instead
+         uint64_t refused = 0;
+      };
+
+      Link(boost::asio::ip::udp::socket& socket, const LinkConfig& config);
+      Link(const Link& other) = delete;
+
+      /// Payloads passed with an owner are no longer copied into the socket buffer (MSG_ZEROCOPY) but pinned until the kernel reports
+      /// on the error queue of the socket that it sent them. Returns false if the kernel does not support it. Only pays off for large
+      /// payloads, as pinning and the notifications cost about as much as copying a few KiB.
+      bool enable_zerocopy();
+      bool zerocopy() const { return zeroCopy; }
+      ZeroCopyStats zerocopy_stats() const { return {zeroCopySent, zeroCopyCopied, zeroCopyRefused}; }
+
+      /// Decides the fate of a packet of size bytes that is sent now, can be called from any thread
+      Schedule schedule(size_t size);
+
+      /// Sends a packet through the link, the handler is called for every copy that is sent
+      template<typename Handler>
+      void send(const unsigned char* data, size_t size, const boost::asio::ip::udp::endpoint& to, Handler handler)
+      {
+         Schedule fate = schedule(size);
+         for (uint8_t i = 0; i < fate.copies; ++i) {
+            if (fate.delay[i].count() == 0) {
+               socket.async_send_to(buffer(data, size), to, handler);
+               continue;
+            }
+
+            auto packet = std::make_shared<std::vector<unsigned char>>(data, data + size);
+            auto timer = std::make_shared<steady_timer>(socket.get_executor(), fate.delay[i]);
+            timer->async_wait([this, packet, timer, to, handler](const boost::system::error_code& error) {
+               if (error) return;
+               socket.async_send_to(buffer(*packet), to, [packet, handler](const boost::system::error_code& error, size_t bytes) { handler(error, bytes); });
+            });
+         }
+      }
+
+      /// Sends a header followed by a payload that is kept alive by owner until the kernel no longer reads it. Without zero-copy sends,
+      /// for delayed copies and if the kernel refuses to pin the payload, the packet is copied and sent as by send().
+      template<typename Handler>
+      void send(std::span<const unsigned char> header, std::span<const unsigned char> payload, std::shared_ptr<const void> owner,
+                const boost::asio::ip::udp::endpoint& to, Handler handler)
+      {
+         Schedule fate = schedule(header.size() + payload.size());
+         for (uint8_t i = 0; i < fate.copies; ++i) {
+            if (fate.delay[i].count() == 0 && zeroCopy && send_zerocopy(header, payload, owner, to)) {
+               handler(boost::system::error_code(), header.size() + payload.size());
+               continue;
+            }
+
+            auto packet = std::make_shared<std::vector<unsigned char>>(header.begin(), header.end());
+            packet->insert(packet->end(), payload.begin(), payload.end());
+            auto timer = std::make_shared<steady_timer>(socket.get_executor(), fate.delay[i]);
+            timer->async_wait([this, packet, timer, to, handler](const boost::system::error_code& error) {
+               if (error) return;
+               socket.async_send_to(buffer(*packet), to, [packet, handler](const boost::system::error_code& error, size_t bytes) { handler(error, bytes); });
+            });
+         }
+      }
+
+    private:
+      /// A payload the kernel may still read from, with the header sent in front of it
+      struct InFlight {
+         std::shared_ptr<const void> owner;
+         std::array<unsigned char, 16> header;
+      };
+
+      bool lost();
+      double draw();
+
+      /// Sends without waiting, false if the packet has to be copied instead
+      bool send_zerocopy(std::span<const unsigned char> header, std::span<const unsigned char> payload, std::shared_ptr<const void> owner,
+                         const boost::asio::ip::udp::endpoint& to);
+      /// Waits for completions on the error queue of the socket, runs on its io_context
+      void await_completions();
+      void read_completions();
+
+      boost::asio::ip::udp::socket& socket;
+      const LinkConfig config;
+
+      std::mutex mux;
+      std::mt19937_64 engine;
+      PacketLossState lossState = PacketLossState::NOT_LOST;
+      /// When the link has sent the packets waiting for the bandwidth
+      timepoint idle;
+      /// Times at which the waiting packets leave the queue
+      std::deque<timepoint> queue;
+
+      std::atomic<bool> zeroCopy = false;
+      /// Held while sending, so that the IDs the kernel numbers the sends with follow the order of inFlight
+      std::mutex zeroCopyMux;
+      uint32_t nextSend = 0;
+      std::map<uint32_t, InFlight> inFlight;
+      std::atomic<uint64_t> zeroCopySent = 0;
+      std::atomic<uint64_t> zeroCopyCopied = 0;
+      std::atomic<uint64_t> zeroCopyRefused = 0;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_LINK_HPP
+// ------------------------------------------------------------------------
@@ -0,0 +1,54 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_LOG_HPP
+#define ROBUST_FILE_TRANSFER_LOG_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include <atomic>
+#include <ostream>
+// ------------------------------------------------------------------------
+/// Statements of the RFT_LOG macros that are less severe are removed at compile time. Release builds keep info and above,
+/// the per-packet statements at debug and verbose severity only exist in debug builds unless this is set, e.g., to plog::verbose.
+#ifndef RFT_LOG_MIN_SEVERITY
+#ifdef NDEBUG
+#define RFT_LOG_MIN_SEVERITY plog::info
+#else
+#define RFT_LOG_MIN_SEVERITY plog::verbose
+#endif
+#endif
+// ------------------------------------------------------------------------
+/// Like PLOG(severity), for statements on per-packet paths. The operands are only evaluated if the statement is logged.
+#define RFT_LOG(severity)                                  \
+   if constexpr ((severity) > RFT_LOG_MIN_SEVERITY) {      \
+   } else                                                  \
+      PLOG(severity)
+// ------------------------------------------------------------------------
+/// Logs at most one statement of this call site per interval, e.g., for warnings a peer can trigger with every packet.
+/// The next statement that is logged reports how many were suppressed.
+#define RFT_LOG_EVERY(severity, interval)                                     \
+   if constexpr ((severity) > RFT_LOG_MIN_SEVERITY) {                         \
+   } else if (static ::rft::log::RateLimit rftLogLimit(interval); !rftLogLimit.allow()) { \
+   } else                                                                     \
+      PLOG(severity) << rftLogLimit
+// ------------------------------------------------------------------------
+namespace rft::log
+{
+   class RateLimit
+   {
+    public:
+      explicit RateLimit(timeunit interval) : interval(interval.count()) {}
+
+      /// Whether a statement may be logged now, otherwise it is counted as suppressed
+      bool allow();
+
+      /// Prefixes the statement with the number of statements suppressed before it
+      friend std::ostream& operator<<(std::ostream& os, const RateLimit& limit);
+
+    private:
+      const int64_t interval;
+      std::atomic<int64_t> next = 0;
+      mutable std::atomic<uint64_t> suppressed = 0;
+   };
+}// namespace rft::log
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_LOG_HPP
+// ------------------------------------------------------------------------
@@ -0,0 +1,56 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_MANIFEST_HPP
+#define ROBUST_FILE_TRANSFER_MANIFEST_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include <optional>
+#include <string>
+#include <vector>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Block signatures of a file that the server publishes, so that a client only fetches the blocks its local copy lacks.
+   /// Blocks are a multiple of CHUNK_SIZE, hence a block always starts at a chunk boundary.
+   class Manifest
+   {
+    public:
+      /// Bytes of the SHA256 of a block that are kept
+      static constexpr uint8_t STRONG_SIZE = 16;
+
+      struct Block {
+         /// rsync rolling checksum
+         uint32_t weak = 0;
+         unsigned char strong[STRONG_SIZE]{};
+      };
+
+      uint64_t fileSize = 0;
+      uint32_t blockSize = 0;
+      std::vector<Block> blocks;
+
+      /// Computes the signatures of the first fileSize bytes of an open file with a block size chosen from its size
+      static Manifest compute(int fd, uint64_t fileSize);
+      /// Reads a manifest in its wire format, returns nothing if the file is malformed
+      static std::optional<Manifest> read(const std::string& filename);
+      bool write(const std::string& filename) const;
+
+      /// Offsets of the manifest's blocks in a local file, -1 for blocks that were not found.
+      /// The last block is only matched if it is a full block.
+      std::vector<int64_t> match(const std::string& basis) const;
+
+      static void strong_checksum(const unsigned char* data, size_t size, unsigned char ret[STRONG_SIZE]);
+
+      /// Files below one block gain nothing from a manifest
+      static constexpr uint32_t MIN_BLOCK_SIZE = 4 * CHUNK_SIZE;
+
+    private:
+      static constexpr uint32_t MAX_BLOCK_SIZE = 2048 * CHUNK_SIZE;
+      /// Bits of the filter that is checked before looking up a weak checksum
+      static constexpr uint8_t FILTER_BITS = 20;
+
+      /// Square root of the file size (c.f. rsync), rounded up to whole chunks
+      static uint32_t block_size(uint64_t fileSize);
+      static uint32_t weak_checksum(const unsigned char* data, size_t size);
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_MANIFEST_HPP
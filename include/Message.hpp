@@ -26,6 +26,9 @@ namespace rft
       SERVER_VALIDATION_REQUEST = 0x01,
       SERVER_INITIAL_RESPONSE = 0x03,
       PAYLOAD = 0x05,// aka Server Data Response
+      PARITY_PAYLOAD = 0x09,// aka Server Parity Response
+      COMPRESSED_PAYLOAD = 0x0B,// aka Server Compressed Data Response
+      SERVER_MANIFEST_RESPONSE = 0x0D,
 
       // Error Types
       ERROR_FILE_NOT_FOUND = 0x11,
@@ -33,6 +36,16 @@ namespace rft
       ERROR_CONNECTION_NOT_FOUND = 0x13
    };
    // ------------------------------------------------------------------------
+   /// Optional features the client supports, announced in the Client Validation Response
+   enum Capability : uint8_t
+   {
+      CAPABILITY_FEC = 0x01,
+      CAPABILITY_COMPRESSION = 0x02,
+      /// The server also opens a connection serving the block signatures of the file (c.f. Manifest), announced with a Server Manifest
+      /// Response ahead of the Server Initial Response
+      CAPABILITY_MANIFEST = 0x04
+   };
+   // ------------------------------------------------------------------------
    template<typename MsgType>
    struct MessageHeader {
       MsgType type;
@@ -44,69 +57,6 @@ namespace rft
    struct Message {
       MessageHeader<MsgType> header;
       unsigned char packet[MAX_PACKET_SIZE]{'\0'};
-
-      /// Pushes T (stack-like) into the message
-      template<typename T>
-      friend Message<MsgType>& operator<<(Message<MsgType>& msg, const T& data)
-      {
-         if constexpr (std::is_integral<T>::value) {
-            T tmp = data;
-            tmp = hton(tmp);
-
-            std::memcpy(&msg.packet[msg.header.size], &tmp, sizeof(tmp));
-         } else {
-            std::memcpy(&msg.packet[msg.header.size], &data, sizeof(data));
-         }
-
-         msg.header.size += sizeof(data);
-         return msg;
-      }
-
-      // Special overload for std::string
-      friend Message<MsgType>& operator<<(Message<MsgType>& msg, const std::string& data)
-      {
-         std::memcpy(&msg.packet[msg.header.size], data.data(), data.size() + 1);
-         msg.header.size += data.size() + 1;
-         return msg;
-      }
-
-      // Special overload for std::vector<unsigned char>
-      friend Message<MsgType>& operator<<(Message<MsgType>& msg, const std::vector<unsigned char>& chunk)
-      {
-         std::memcpy(&msg.packet[msg.header.size], chunk.data(), chunk.size());
-         msg.header.size += chunk.size();
-         return msg;
-      }
-      // ------------------------------------------------------------------------
-      /// Pops data (stack-like) from the message into T
-      template<typename T>
-      friend Message<MsgType>& operator>>(Message<MsgType>& msg, T& data)
-      {
-         msg.header.size -= sizeof(data);
-         std::memcpy(&data, &msg.packet[msg.header.size], sizeof(data));
-
-         if constexpr (std::is_integral<T>::value) {
-            data = ntoh(data);
-         }
-
-         return msg;
-      }
-
-      // Special overload for std::string
-      friend Message<MsgType>& operator>>(Message<MsgType>& msg, std::string& data)
-      {
-         msg.header.size -= data.size() + 1;
-         std::memcpy(data.data(), &msg.packet[msg.header.size], data.size() + 1);
-         return msg;
-      }
-
-      // Special overload for std::vector<unsigned char>
-      friend Message<MsgType>& operator>>(Message<MsgType>& msg, std::vector<unsigned char>& chunk)
-      {
-         msg.header.size -= chunk.size();
-         std::memcpy(chunk.data(), &msg.packet[msg.header.size], chunk.size());
-         return msg;
-      }
    };
 }// namespace rft
 // ------------------------------------------------------------------------
@@ -46,19 +46,23 @@ namespace rft
 
       void push_front(const Message& msg)
       {
-         std::unique_lock lock_1(mux_queue);
-         deque.emplace_front(std::move(msg));
+         {
+            std::unique_lock lock(mux_queue);
+            deque.emplace_front(std::move(msg));
+         }
 
-         std::unique_lock lock_2(mux_cv);
+         std::unique_lock lock(mux_cv);
          cv.notify_one();
       }
 
       void push_back(const Message& msg)
       {
-         std::unique_lock lock_1(mux_queue);
-         deque.emplace_back(std::move(msg));
+         {
+            std::unique_lock lock(mux_queue);
+            deque.emplace_back(std::move(msg));
+         }
 
-         std::unique_lock lock_2(mux_cv);
+         std::unique_lock lock(mux_cv);
          cv.notify_one();
       }
 
@@ -80,15 +84,19 @@ namespace rft
          return deque.clear();
       }
 
-      void wait()
+      /// Waits until a message arrives, wake() is called or the timeout expires
+      void wait(nanos timeout = seconds(3))
       {
+         // the queue mutex is never held while locking mux_cv, hence checking the queue here cannot deadlock
          std::unique_lock lock(mux_cv);
-         cv.wait_for(lock, seconds(3));
+         cv.wait_for(lock, timeout, [this]() { return woken || !empty(); });
+         woken = false;
       }
 
       void wake()
       {
          std::unique_lock lock(mux_cv);
+         woken = true;
          cv.notify_one();
       }
 
@@ -97,6 +105,7 @@ namespace rft
       std::deque<Message> deque;
       std::condition_variable cv;
       std::mutex mux_cv;
+      bool woken = false;
    };
 }// namespace rft
 // ------------------------------------------------------------------------
@@ -0,0 +1,69 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_METRICS_HPP
+#define ROBUST_FILE_TRANSFER_METRICS_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include <atomic>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Distribution of observed values over fixed buckets, can be updated from any thread
+   class Histogram
+   {
+      friend class Exposition;
+
+    public:
+      /// Upper bounds of the buckets in ascending order, values above the last bound are only counted in total
+      explicit Histogram(std::vector<double> bounds);
+      Histogram(const Histogram& other) = delete;
+
+      void observe(double value);
+
+    private:
+      const std::vector<double> bounds;
+      /// Observations per bucket, not cumulative
+      std::unique_ptr<std::atomic<uint64_t>[]> buckets;
+      std::atomic<uint64_t> count = 0;
+      std::atomic<double> sum = 0;
+   };
+   // ------------------------------------------------------------------------
+   /// Page of metrics in the Prometheus text exposition format. All samples carry the labels the page was created with.
+   class Exposition
+   {
+    public:
+      /// Labels in the exposition syntax, e.g., role="server"
+      explicit Exposition(std::string labels) : labels(std::move(labels)) {}
+
+      void counter(const std::string& name, const std::string& help, uint64_t value);
+      void gauge(const std::string& name, const std::string& help, double value);
+      void histogram(const std::string& name, const std::string& help, const Histogram& histogram);
+      /// Starts a metric whose samples differ in their labels, e.g., one per connection
+      void family(const std::string& name, const std::string& type, const std::string& help);
+      void sample(const std::string& name, const std::string& labels, double value);
+
+      std::string str() const { return out.str(); }
+      /// Escapes a label value, e.g., a filename
+      static std::string escape(const std::string& value);
+      /// Replaces the file atomically, so that a reader never sees a partial page
+      static bool write(const std::string& path, const std::string& page);
+
+    private:
+      std::string with(const std::string& extra) const;
+      void value(double value);
+
+      const std::string labels;
+      std::ostringstream out;
+   };
+   // ------------------------------------------------------------------------
+   /// How often the server and the client write their metrics
+   constexpr seconds METRICS_INTERVAL = seconds(1);
+   /// Buckets of handshake latencies in seconds
+   const std::vector<double> HANDSHAKE_BUCKETS = {0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_METRICS_HPP
+// ------------------------------------------------------------------------
@@ -0,0 +1,30 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_PARITYCONTROL_HPP
+#define ROBUST_FILE_TRANSFER_PARITYCONTROL_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Chooses the number of XOR parity chunks of a window from the loss rate the client reports
+   class ParityControl
+   {
+      friend class Server;
+
+      /// Weight of the loss rate of the last window
+      const double ALPHA = 0.25;
+      /// Below this loss rate no parity is sent
+      const double MIN_LOSS_RATE = 0.005;
+      /// A group of two chunks and their parity recovers every second loss
+      const uint16_t MIN_GROUP_SIZE = 2;
+      const uint16_t MAX_GROUP_SIZE = 32;
+
+      double lossRate = 0;
+
+      void addSample(uint16_t chunksLost, uint16_t windowSize);
+      /// Number of parity groups of a window, 0 if no parity is sent
+      uint16_t getParityGroups(uint16_t windowSize) const;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_PARITYCONTROL_HPP
@@ -0,0 +1,101 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_READCACHE_HPP
+#define ROBUST_FILE_TRANSFER_READCACHE_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include <array>
+#include <future>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Blocks of served files shared by all connections of the server, so that a file requested by many clients is read from disk once.
+   /// The cache is split into shards with a lock and an LRU list each, the memory budget is divided evenly among them.
+   class ReadCache
+   {
+    public:
+      /// Identifies the contents of a file, a file that is modified or replaced gets a new identity
+      struct FileId {
+         uint64_t device = 0;
+         uint64_t inode = 0;
+         int64_t mtime = 0;
+         uint64_t size = 0;
+
+         bool operator==(const FileId& other) const = default;
+      };
+
+      struct FileIdHash {
+         size_t operator()(const FileId& file) const;
+      };
+
+      /// Blocks are whole chunks, so that a chunk never spans two blocks
+      static constexpr uint16_t BLOCK_CHUNKS = 64;
+      static constexpr size_t BLOCK_SIZE = BLOCK_CHUNKS * CHUNK_SIZE;
+
+      class Block
+      {
+       public:
+         explicit Block(size_t size) : data(size) {}
+
+         std::vector<unsigned char> data;
+
+         /// Every chunk compressed on its own, so that the encoding fits any window. Computed once for all connections
+         /// sending the block; a chunk that does not compress well is empty. The encoding is not counted against the budget.
+         const std::vector<unsigned char>& compressed(uint16_t chunk) const;
+
+       private:
+         mutable std::once_flag compressOnce;
+         mutable std::vector<std::vector<unsigned char>> chunks;
+      };
+
+      /// Budget in bytes, a budget of 0 disables the cache
+      explicit ReadCache(size_t budget);
+      ReadCache(const ReadCache& other) = delete;
+
+      /// Identity of an open regular file, nothing for other files. Taken from the descriptor rather than the path, so that it cannot
+      /// belong to a file that replaced the opened one in the meantime.
+      static std::optional<FileId> identify(int fd);
+      /// Identity of the regular file at path, which may be replaced right after it was taken
+      static std::optional<FileId> identify(const std::string& path);
+
+      bool enabled() const { return shardBudget >= BLOCK_SIZE; }
+      /// Returns a block of a file, which is read from fd if it is not cached. A block that is being read, e.g., ahead of its connection,
+      /// is waited for instead of being read twice. The block stays valid after it was evicted.
+      std::shared_ptr<const Block> get(const FileId& file, uint64_t block, int fd);
+
+    private:
+      static constexpr uint8_t SHARDS = 16;
+
+      struct Key {
+         FileId file;
+         uint64_t block;
+
+         bool operator==(const Key& other) const = default;
+      };
+
+      struct KeyHash {
+         size_t operator()(const Key& key) const;
+      };
+
+      struct Shard {
+         std::mutex mux;
+         /// Most recently used block at the front
+         std::list<std::pair<Key, std::shared_ptr<const Block>>> lru;
+         std::unordered_map<Key, decltype(lru)::iterator, KeyHash> blocks;
+         /// Blocks that are being read, without the lock
+         std::unordered_map<Key, std::shared_future<std::shared_ptr<const Block>>, KeyHash> pending;
+         size_t used = 0;
+      };
+
+      size_t shardBudget;
+      std::array<Shard, SHARDS> shards;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_READCACHE_HPP
@@ -0,0 +1,41 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_RTTESTIMATOR_HPP
+#define ROBUST_FILE_TRANSFER_RTTESTIMATOR_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Smoothed round-trip time and retransmission timeout of a single connection (RFC 6298)
+   class RttEstimator
+   {
+    public:
+      void addSample(timeunit rtt);
+      /// Doubles the retransmission timeout after the timeout expired
+      void backoff();
+
+      bool hasSample() const { return srtt.count() != 0; }
+      timeunit smoothedRtt() const { return srtt; }
+      timeunit variance() const { return rttvar; }
+      timeunit rto() const;
+
+    private:
+      static constexpr double ALPHA = 1.0 / 8;
+      static constexpr double BETA = 1.0 / 4;
+      static constexpr uint8_t K = 4;
+      /// Timeout before the first sample was taken
+      static constexpr timeunit INITIAL_RTO = seconds(1);
+      /// The RFC recommends a minimum of one second, which is far too long for the short paths ARFT is used on
+      static constexpr timeunit MIN_RTO = millis(10);
+      static constexpr timeunit MAX_RTO = seconds(60);
+      /// Resolution of the TimerWheel
+      static constexpr timeunit GRANULARITY = millis(1);
+      static constexpr uint8_t MAX_BACKOFFS = 6;
+
+      timeunit srtt{0};
+      timeunit rttvar{0};
+      uint8_t backoffs = 0;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_RTTESTIMATOR_HPP
@@ -1,14 +1,20 @@
 #ifndef ROBUST_FILE_TRANSFER_SERVER_HPP
 #define ROBUST_FILE_TRANSFER_SERVER_HPP
 // ------------------------------------------------------------------------
+#include "ConnectionTable.hpp"
 #include "CongestionControl.hpp"
+#include "DifficultyControl.hpp"
+#include "FileCache.hpp"
+#include "Link.hpp"
+#include "Metrics.hpp"
 #include "MessageQueue.hpp"
+#include "ParityControl.hpp"
+#include "ReadCache.hpp"
 #include "Timer.hpp"
 #include "Window.hpp"
+#include "Wire.hpp"
 #include "common.hpp"
 #include "util.hpp"
-#include <fstream>
-#include <unordered_map>
 #include <utility>
 // ------------------------------------------------------------------------
 namespace rft
@@ -21,35 +27,88 @@ namespace rft
       {
          friend class Server;
 
-         Connection(boost::asio::ip::udp::endpoint client, std::ifstream file, uint16_t maxThroughput, Window window, boost::asio::io_context& io_context)
-             : client(std::move(client)), file(std::move(file)), window(std::move(window)), cc(maxThroughput), timer(io_context)
+       public:
+         // public for the ConnectionTable, the class itself is private to the Server
+         Connection(boost::asio::ip::udp::endpoint client, std::shared_ptr<const FileCache::File> file, std::optional<ReadCache::FileId> fileId, uint16_t maxThroughput, uint8_t capabilities, TimerWheel& timers)
+             : client(std::move(client)), file(std::move(file)), fileId(fileId), fileSize(this->file->size()), cc(maxThroughput), capabilities(capabilities), timer(timers)
          {}
 
+       private:
+
          boost::asio::ip::udp::endpoint client;
-         std::ifstream file;
-         Window window;
+         /// Shared with the other connections transferring the same file
+         std::shared_ptr<const FileCache::File> file;
+         /// Files without an identity, e.g., manifests, are not cached
+         std::optional<ReadCache::FileId> fileId;
+         uint64_t fileSize;
+         SendWindow window;
          CongestionControl cc;
+         /// Optional features the client asked for (c.f. Capability)
+         uint8_t capabilities;
+         ParityControl parity;
+         /// Shared by the connections transferring the same version of the file, its use count is their number
+         std::shared_ptr<const ReadCache::FileId> transfers;
+
+         /// Chunks up to this index were read ahead already
+         uint64_t readAhead = 0;
+
+         uint64_t chunksSent = 0;
+         uint64_t chunksRetransmitted = 0;
+         uint32_t phaseChanges = 0;
 
          Timer timer;
       };
       // ------------------------------------------------------------------------
+      /// A chunk of a file, within its cached block if the file is cached, otherwise in the buffer it was read into
+      struct Chunk {
+         std::shared_ptr<const ReadCache::Block> block;
+         wire::Bytes data;
+      };
+      // ------------------------------------------------------------------------
+      /// Transport counters of all connections, updated from the processing, the io_context and the worker threads
+      struct Counters {
+         std::atomic<uint64_t> packetsSent = 0;
+         std::atomic<uint64_t> bytesSent = 0;
+         std::atomic<uint64_t> packetsReceived = 0;
+         std::atomic<uint64_t> bytesReceived = 0;
+         std::atomic<uint64_t> chunksSent = 0;
+         std::atomic<uint64_t> chunksRetransmitted = 0;
+         std::atomic<uint64_t> chunksReadAhead = 0;
+         std::atomic<uint64_t> transmissionRequests = 0;
+         std::atomic<uint64_t> retransmissionRequests = 0;
+         std::atomic<uint64_t> phaseChanges = 0;
+         std::atomic<uint64_t> timeouts = 0;
+         std::atomic<uint64_t> connectionsOpened = 0;
+         std::atomic<uint64_t> connectionsClosed = 0;
+      };
+      // ------------------------------------------------------------------------
 
     public:
-      explicit Server(size_t port, double p, double q);
+      /// The metrics are written to metricsFile every METRICS_INTERVAL unless it is empty. With zeroCopy, cached chunks are sent without
+      /// copying them into the socket buffer (c.f. Link::enable_zerocopy()).
+      Server(size_t port, const LinkConfig& link, bool useReputation, size_t cacheSize, bool zeroCopy, const std::string& metricsFile);
       Server(const Server& other) = delete;
       Server(const Server&& other) = delete;
       ~Server();
 
+      /// Serves files until stop() is called
       void start();
+      /// Can be called from any thread, start() returns once the server has stopped
       void stop();
 
     private:
-      [[noreturn]] void process_msgs();
+      void shutdown();
+      void process_msgs();
 
       void dispatch_msg(Message<ClientMsgType>& msg);
 
       void receive_msg();
       void send_msg_to_client(Message<ServerMsgType> msg, const boost::asio::ip::udp::endpoint& client);
+      /// Sends a packet from any thread, it is sent on the strand of the socket and kept alive until the send completed
+      void send_msg_to_client(std::shared_ptr<const Message<ServerMsgType>> msg, const boost::asio::ip::udp::endpoint& client);
+      /// Compresses consecutive chunks of a window and sends them, run on a worker thread
+      void send_compressed(ConnectionID connectionId, uint8_t windowId, uint16_t windowSize, uint16_t first, uint16_t count,
+                           const std::vector<unsigned char>& chunks, const boost::asio::ip::udp::endpoint& client);
 
       void handle_receive(const boost::system::error_code& error, size_t bytes_transferred);
       void handle_send(const boost::system::error_code& error, size_t bytes_transferred);
@@ -57,34 +116,79 @@ namespace rft
       void enqueue_msg(size_t bytes_transferred);
       void decode_msg(size_t bytes_transferred);
       void set_timeout(ConnectionID connectionId);
+      /// The token counting the connections that transfer a file (c.f. Connection::transfers)
+      std::shared_ptr<const ReadCache::FileId> count_transfer(const ReadCache::FileId& file);
+      /// Whether other connections transfer the same file, the chunks are then compressed once for all of them. Connections without
+      /// compression share the blocks of the read cache only, every packet still carries the fields of its own connection and window.
+      bool is_shared(const Connection& conn) const;
+      /// Sends consecutive chunks of the current window within a block with the block's shared encoding
+      void send_shared(Connection& conn, ConnectionID connectionId, uint16_t first, uint16_t count, const boost::asio::ip::udp::endpoint& client);
+      /// Sends the chunks of a block, run on a worker thread
+      void send_block(ConnectionID connectionId, uint8_t windowId, uint16_t windowSize, uint16_t first, uint16_t count,
+                      const std::shared_ptr<const ReadCache::Block>& block, uint16_t offset, const boost::asio::ip::udp::endpoint& client);
+      /// Reads a chunk of the connection's file through the cache, the chunk is empty past the end of the file
+      Chunk read_chunk(Connection& conn, uint64_t chunkIdx, unsigned char buffer[CHUNK_SIZE]);
+      /// Sends chunk i of the current window as PAYLOAD, a cached chunk is not copied with zero-copy sends
+      void send_payload(Message<ServerMsgType>& msgOut, ConnectionID connectionId, const Connection& conn, uint16_t i, const Chunk& chunk,
+                        const boost::asio::ip::udp::endpoint& client);
+      /// Reads the windows following the current one on a reader thread, into the cache or the page cache, so that the next Transmission
+      /// Request does not wait for the disk. Nothing is read past the limit of the client's window (c.f. Transmission Request), the
+      /// client has the chunks behind it.
+      void read_ahead(Connection& conn, uint32_t limit);
 
       void handle_file_request(Message<ClientMsgType>& msg);
       void handle_validation_response(Message<ClientMsgType>& msg);
+      /// Opens a connection serving the manifest of a file and announces it with a Server Manifest Response, nothing if it fails
+      void open_manifest(const FileCache::File& file, const std::string& filename, uint16_t maxThroughput, uint8_t capabilities,
+                         const boost::asio::ip::udp::endpoint& client);
       void handle_transmission_request(Message<ClientMsgType>& msg);
       void handle_retransmission_request(Message<ClientMsgType>& msg);
       void handle_finish(Message<ClientMsgType>& msg);
       void handle_timeout(ConnectionID connectionId);
+      /// Writes the counters and the state of every connection, runs on the thread processing the messages
+      void export_metrics();
 
       boost::asio::io_context io_context;
       boost::asio::ip::udp::socket socket;
+      /// Packets are sent from the main thread and the worker threads
+      Link link;
       std::thread thread_context;
+      /// Time-consuming work that is moved off the thread processing the messages
+      boost::asio::thread_pool workers;
+      /// Reads ahead of the connections, apart from the workers, so that waiting for the disk does not hold up the checksums and sends
+      boost::asio::thread_pool readers{READ_AHEAD_THREADS};
+      std::atomic<bool> running = false;
       size_t port;
       boost::asio::ip::udp::endpoint remote_endpoint;
 
-      std::unordered_map<ConnectionID, Connection> connections;
-      std::atomic<ConnectionID> connectionIdPool = 0;
+      /// Timeouts of all connections, expired on the thread processing the messages
+      TimerWheel timers;
+      ConnectionTable<Connection> connections;
 
       Message<ClientMsgType> msgIn{};
       MessageQueue<Message<ClientMsgType>> msgQueue;
 
       const size_t TIMEOUT = 3;
+      /// Windows of the current size that are read ahead
+      static constexpr uint64_t READ_AHEAD_WINDOWS = 2;
+      static constexpr size_t READ_AHEAD_THREADS = 2;
 
       const std::string SERVER_SECRET = "SERVER_SECRET";
-      const uint8_t DIFFICULTY = 10;
-
-      PacketLossState packetLossState = PacketLossState::NOT_LOST;
-      double p;
-      double q;
+      DifficultyControl difficultyControl;
+      /// Files kept open between connections, each holds a file descriptor
+      static constexpr size_t OPEN_FILES = 256;
+      FileCache files{OPEN_FILES};
+      ReadCache cache;
+      std::mutex transfersMux;
+      std::unordered_map<ReadCache::FileId, std::weak_ptr<const ReadCache::FileId>, ReadCache::FileIdHash> transfers;
+      /// Number of validation responses posted to the io_context that have not been handled yet
+      std::atomic<size_t> pendingValidations = 0;
+
+      Counters counters;
+      /// Time from a Client Validation Response until the Server Initial Response, mostly spent on the checksum of the file
+      Histogram handshakeProcessing{HANDSHAKE_BUCKETS};
+      std::string metricsFile;
+      Timer metricsTimer{timers};
    };
 }// namespace rft
 // ------------------------------------------------------------------------
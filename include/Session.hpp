@@ -0,0 +1,79 @@
+#ifndef ROBUST_FILE_TRANSFER_SESSION_HPP
+#define ROBUST_FILE_TRANSFER_SESSION_HPP
+// ------------------------------------------------------------------------
+#include "Client.hpp"
+#include "Link.hpp"
+#include "common.hpp"
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+// ------------------------------------------------------------------------
+namespace rft
+// ------------------------------------------------------------------------
+{
+   /// Options of a transfer, c.f. the options of rft in client mode
+   struct TransferOptions {
+      std::string dest = "/tmp";
+      LinkConfig link;
+      /// Optional features the server is asked for (c.f. Capability)
+      uint8_t capabilities = 0;
+      /// Files that exist at the destination are updated by transferring only the blocks that changed
+      bool useDelta = false;
+      /// Received files bypass the page cache, e.g., for transfers much larger than the memory of the host
+      bool directIo = false;
+      std::string cacheDir;
+      std::string metricsFile;
+      /// Called on the threads running the io_context, concurrently for different files. It may cancel the transfer but not destroy it.
+      Client::ProgressHandler onProgress;
+   };
+   // ------------------------------------------------------------------------
+   struct TransferResult {
+      /// Compare filesTransferred with the number of requested files to find out whether all of them were transferred
+      Client::Statistics statistics;
+      bool cancelled = false;
+   };
+   // ------------------------------------------------------------------------
+   /// Files that are transferred in the background, destroying the transfer cancels it
+   class Transfer
+   {
+    public:
+      Transfer(boost::asio::io_context& context, const boost::asio::ip::udp::endpoint& server, std::vector<std::string> files, const TransferOptions& options);
+      Transfer(const Transfer& other) = delete;
+      Transfer(const Transfer&& other) = delete;
+      /// Waits for pending operations on the io_context, it must not be the only thread running it
+      ~Transfer();
+
+      /// Ready once every file was transferred or given up on, e.g., because it could not be created at the destination, or the transfer
+      /// was cancelled
+      std::shared_future<TransferResult> result() const { return done; }
+      /// Stops the transfer and deletes the incomplete files, can be called from any thread
+      void cancel() { client.cancel(); }
+
+    private:
+      Client client;
+      std::promise<TransferResult> promise;
+      std::shared_future<TransferResult> done;
+   };
+   // ------------------------------------------------------------------------
+   /// Transfers from a server embedded into a long-running service. The transfers share the io_context of the service, which has to run while
+   /// they exist, and the address of the server, which is resolved only once.
+   class Session
+   {
+    public:
+      /// Throws if the server cannot be resolved
+      Session(boost::asio::io_context& context, const std::string& host, size_t port);
+
+      /// Starts to transfer the files, each transfer has its own socket and can run concurrently with the others, as do the files of a transfer
+      std::unique_ptr<Transfer> start(std::vector<std::string> files, const TransferOptions& options = {});
+
+      const boost::asio::ip::udp::endpoint& server() const { return endpoint; }
+
+    private:
+      boost::asio::io_context& context;
+      boost::asio::ip::udp::endpoint endpoint;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_SESSION_HPP
+// ------------------------------------------------------------------------
@@ -1,32 +1,42 @@
 #ifndef ROBUST_FILE_TRANSFER_TIMER_HPP
 #define ROBUST_FILE_TRANSFER_TIMER_HPP
 // ------------------------------------------------------------------------
+#include "TimerWheel.hpp"
 #include "common.hpp"
 // ------------------------------------------------------------------------
 namespace rft
 {
    class Timer
    {
-      boost::asio::steady_timer t;
+      TimerWheel& wheel;
+      TimerWheel::Node node;
 
     public:
-      explicit Timer(boost::asio::io_context& io_context) : t(io_context) {}
+      explicit Timer(TimerWheel& wheel) : wheel(wheel) {}
+      Timer(Timer&& other) noexcept : wheel(other.wheel) { wheel.move(other.node, node); }
+      ~Timer() { wheel.cancel(node); }
 
       template<typename Timeunit>
-      void setTimeout(Timeunit timeout, std::function<void(const boost::system::error_code& error_code)> callback)
+      void setTimeout(Timeunit timeout, std::function<void()> callback)
       {
-         t.expires_after(timeunit(timeout));
-         t.async_wait(callback);
+         wheel.schedule(node, TimerWheel::clock::now() + timeout, std::move(callback));
+      }
+
+      /// Re-arms the timer with the callback of the last setTimeout call
+      template<typename Timeunit>
+      void setTimeout(Timeunit timeout)
+      {
+         wheel.reschedule(node, TimerWheel::clock::now() + timeout);
       }
 
       bool isExpired()
       {
-         return t.expiry() <= steady_timer::clock_type::now();
+         return wheel.isExpired(node);
       }
 
       void cancel()
       {
-         t.cancel();
+         wheel.cancel(node);
       }
    };
 }// namespace rft
@@ -0,0 +1,74 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_TIMERWHEEL_HPP
+#define ROBUST_FILE_TRANSFER_TIMERWHEEL_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include <array>
+#include <functional>
+#include <mutex>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Hierarchical timing wheel with O(1) arming and re-arming of timers.
+   /// Timers expire lazily: a re-armed timer stays in its slot and is only moved once that slot is reached.
+   /// The wheel does not run by itself, the owner calls advance() which runs the callbacks of expired timers on its thread.
+   class TimerWheel
+   {
+    public:
+      using clock = chrono::steady_clock;
+
+      struct Node {
+         Node* prev = nullptr;
+         Node* next = nullptr;
+         /// Head of the list the node is linked into, nullptr if the timer is not armed
+         Node** list = nullptr;
+         /// Tick of the slot the node is linked into
+         uint64_t tick = 0;
+         clock::time_point deadline;
+         std::function<void()> callback;
+      };
+
+      explicit TimerWheel(micros resolution = millis(1));
+      TimerWheel(const TimerWheel& other) = delete;
+      TimerWheel(const TimerWheel&& other) = delete;
+
+      void schedule(Node& node, clock::time_point deadline, std::function<void()> callback);
+      /// Arms the timer again with its previous callback
+      void reschedule(Node& node, clock::time_point deadline);
+      void cancel(Node& node);
+      bool isExpired(const Node& node);
+      /// Transfers the position of a moved timer to its new node
+      void move(Node& from, Node& to);
+
+      /// Runs the callbacks of all expired timers and returns the time until advance() should be called again
+      nanos advance();
+
+    private:
+      static constexpr uint8_t LEVELS = 4;
+      static constexpr uint8_t SLOT_BITS = 8;
+      static constexpr uint32_t SLOTS = 1U << SLOT_BITS;
+      /// Time to wait if no timer is armed
+      static constexpr seconds IDLE_WAIT = seconds(3);
+
+      uint64_t tick_of(clock::time_point tp) const;
+      void arm(Node& node, clock::time_point deadline);
+      /// Links the node into the slot of its deadline, but not before the earliest tick
+      void insert(Node& node, uint64_t earliest);
+      void cascade(uint8_t level);
+      void link(Node& node, Node*& list);
+      void unlink(Node& node);
+
+      const micros resolution;
+      const clock::time_point start = clock::now();
+      uint64_t currentTick = 0;
+      size_t armed = 0;
+
+      std::array<std::array<Node*, SLOTS>, LEVELS> slots{};
+      /// Timers that expired and whose callback has not been run yet
+      Node* expired = nullptr;
+
+      std::mutex mux;
+   };
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_TIMERWHEEL_HPP
@@ -0,0 +1,88 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_TRACE_HPP
+#define ROBUST_FILE_TRANSFER_TRACE_HPP
+// ------------------------------------------------------------------------
+#include "common.hpp"
+#include <atomic>
+#include <string>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   /// Binary event trace of the whole process, meant to be left on. Every thread records into its own ring buffer without
+   /// locking, a background thread appends the rings to the trace file. Events that do not fit into a full ring are dropped
+   /// and counted. The file is a header (c.f. trace::FileHeader) followed by events in the order they were flushed,
+   /// rft_trace (c.f. tools/rft_trace.cpp) converts it into qlog or CSV.
+   namespace trace
+   {
+      enum class Source : uint8_t
+      {
+         SERVER = 0,
+         CLIENT = 1
+      };
+
+      enum class EventType : uint8_t
+      {
+         /// values hold the first 16 bytes of the packet
+         PACKET_SENT = 0,
+         PACKET_RECEIVED = 1,
+         /// values: first chunk, chunks of the window
+         WINDOW_STARTED = 2,
+         /// values: chunks of the window, chunks that arrived with its first transmission
+         WINDOW_COMPLETED = 3,
+         /// values: cwnd, rttCurrent, rttMax (microseconds), phase (c.f. CongestionControl)
+         CC_DECISION = 4,
+         /// values: smoothed RTT, RTO (microseconds)
+         RTT_SAMPLE = 5,
+         /// values: chunks asked for again
+         RETRANSMISSION = 6,
+         /// values: what timed out (c.f. Timeout)
+         TIMEOUT = 7
+      };
+
+      enum Timeout : uint32_t
+      {
+         TRANSMISSION_TIMEOUT = 0,
+         RETRANSMISSION_TIMEOUT = 1,
+         FILE_REQUEST_TIMEOUT = 2,
+         CONNECTION_TIMEOUT = 3
+      };
+
+      struct Event {
+         /// Nanoseconds since the trace was opened
+         uint64_t time;
+         EventType type;
+         Source source;
+         /// Size of a packet
+         uint16_t size;
+         ConnectionID connection;
+         uint32_t values[4];
+      };
+      static_assert(sizeof(Event) == 32);
+
+      struct FileHeader {
+         char magic[8];
+         uint32_t version;
+         uint32_t eventSize;
+         /// Wall-clock time the trace was opened at, nanoseconds since the epoch
+         uint64_t start;
+      };
+      constexpr char MAGIC[8] = {'R', 'F', 'T', 'T', 'R', 'A', 'C', 'E'};
+      constexpr uint32_t VERSION = 1;
+
+      /// Starts tracing into the file, returns false if it cannot be created
+      bool open(const std::string& path);
+      /// Writes the remaining events and closes the file
+      void close();
+      /// Events that were dropped since the ring of their thread was full
+      uint64_t dropped();
+
+      extern std::atomic<bool> active;
+      inline bool enabled() { return active.load(std::memory_order_relaxed); }
+
+      void record(Source source, EventType type, ConnectionID connection, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0);
+      void packet(Source source, EventType type, const unsigned char* packet, size_t size);
+   }// namespace trace
+}// namespace rft
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_TRACE_HPP
+// ------------------------------------------------------------------------
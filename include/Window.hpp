@@ -1,36 +1,78 @@
 #ifndef ROBUST_FILE_TRANSFER_WINDOW_HPP
 #define ROBUST_FILE_TRANSFER_WINDOW_HPP
 // ------------------------------------------------------------------------
+#include "Bitfield.hpp"
 #include "common.hpp"
+#include <span>
 #include <vector>
 // ------------------------------------------------------------------------
 namespace rft
 {
    struct Window {
-      explicit Window(uint16_t maxSize)
+      explicit Window(uint16_t maxSize) : sequenceNumbers(maxSize)
       {
          chunks.resize(maxSize);
-         sequenceNumbers.resize(maxSize, false);
       }
 
+      /// XOR of the chunks of a parity group, zero padded to the longest chunk
+      struct Parity {
+         std::vector<unsigned char> data;
+         /// XOR of the lengths of the chunks
+         uint16_t lengths = 0;
+         bool received = false;
+      };
+
       std::vector<std::vector<unsigned char>> chunks;
       uint8_t id = 0;
       uint16_t currentSize = 1;
       uint16_t chunksReceived = 0;
-      std::vector<bool> sequenceNumbers;
+      /// Chunks that arrived with the first transmission of the window, the others were lost
+      uint16_t chunksTransmitted = 0;
+      bool retransmitting = false;
+      Bitfield sequenceNumbers;
+      /// Chunk i belongs to parity group i % parities.size()
+      std::vector<Parity> parities;
 
-      void store_chunk(std::vector<unsigned char>& chunk, const uint16_t sequenceNumber)
+      /// The chunk is copied into the buffer the window keeps for its sequence number, which is reused by every window
+      void store_chunk(std::span<const unsigned char> chunk, const uint16_t sequenceNumber)
       {
-         chunks[sequenceNumber] = std::move(chunk);
-         sequenceNumbers[sequenceNumber] = true;
-         ++chunksReceived;
+         if (!insert_chunk(chunk, sequenceNumber)) return;
+
+         if (!retransmitting) {
+            ++chunksTransmitted;
+         }
+         if (!parities.empty()) {
+            recover(sequenceNumber % parities.size());
+         }
+      }
+
+      void store_parity(std::span<const unsigned char> parity, uint16_t lengths, uint16_t group, uint16_t groups)
+      {
+         if (groups == 0 || groups > chunks.size() || group >= groups) return;
+
+         // the number of groups is the same for all parity packets of a window
+         if (parities.size() != groups) {
+            parities.assign(groups, Parity{});
+         }
+
+         auto& p = parities[group];
+         if (p.received) return;
+         p.data.assign(parity.begin(), parity.end());
+         p.lengths = lengths;
+         p.received = true;
+
+         recover(group);
       }
 
       void reset()
       {
          chunksReceived = 0;
-         for (auto&& b: sequenceNumbers) {
-            b = false;
+         chunksTransmitted = 0;
+         retransmitting = false;
+         sequenceNumbers.reset();
+         // the buffers of the groups are kept for the next window, which usually has as many
+         for (auto& p: parities) {
+            p.received = false;
          }
       }
 
@@ -38,6 +80,60 @@ namespace rft
       {
          return chunksReceived == currentSize;
       }
+
+    private:
+      bool insert_chunk(std::span<const unsigned char> chunk, const uint16_t sequenceNumber)
+      {
+         if (sequenceNumber >= chunks.size()) return false;
+
+         // A duplicate (e.g. a retransmitted chunk whose original arrived late) must not be counted twice
+         if (!sequenceNumbers.set(sequenceNumber)) return false;
+
+         chunks[sequenceNumber].assign(chunk.begin(), chunk.end());
+         ++chunksReceived;
+         return true;
+      }
+
+      /// Reconstructs the chunk of a group if it is the only one missing
+      void recover(uint16_t group)
+      {
+         auto& p = parities[group];
+         if (!p.received) return;
+
+         const uint16_t groups = parities.size();
+         const uint16_t end = std::min<size_t>(currentSize, chunks.size());
+         uint16_t missing = end;
+         for (uint16_t i = group; i < end; i += groups) {
+            if (!sequenceNumbers[i]) {
+               if (missing != end) return;
+               missing = i;
+            }
+         }
+         if (missing == end) return;
+
+         std::vector<unsigned char> chunk(p.data);
+         uint16_t length = p.lengths;
+         for (uint16_t i = group; i < end; i += groups) {
+            if (i == missing) continue;
+            if (chunks[i].size() > chunk.size()) return;
+            for (size_t b = 0; b < chunks[i].size(); ++b) {
+               chunk[b] ^= chunks[i][b];
+            }
+            length ^= chunks[i].size();
+         }
+         if (length > chunk.size()) return;
+
+         chunk.resize(length);
+         insert_chunk(chunk, missing);
+      }
+   };
+   // ------------------------------------------------------------------------
+   /// The sender only keeps the position of the current window, lost chunks are read from the file again
+   struct SendWindow {
+      uint8_t id = 0;
+      uint16_t currentSize = 1;
+      /// Absolute index of the first chunk of the window in the file
+      uint32_t chunkIdx = 0;
    };
 }// namespace rft
 // ------------------------------------------------------------------------
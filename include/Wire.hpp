@@ -0,0 +1,363 @@
+// ------------------------------------------------------------------------
+#ifndef ROBUST_FILE_TRANSFER_WIRE_HPP
+#define ROBUST_FILE_TRANSFER_WIRE_HPP
+// ------------------------------------------------------------------------
+#include "Message.hpp"
+#include "common.hpp"
+#include "util.hpp"
+#include <array>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+// ------------------------------------------------------------------------
+/// Typed views of the messages (c.f. SPECIFICATION.md) that are parsed in place from a received packet and encoded directly into a
+/// packet to send. Parsing checks every size before a byte is read, a malformed packet is rejected with std::nullopt.
+namespace rft::wire {
+   using Hash = std::array<unsigned char, SHA256_SIZE>;
+   using Bytes = std::span<const unsigned char>;
+   // ------------------------------------------------------------------------
+   template<typename T>
+   void load(const unsigned char*& pos, T& field)
+   {
+      std::memcpy(&field, pos, sizeof(T));
+      if constexpr (std::is_integral_v<T> && sizeof(T) > 1) {
+         field = ntoh(field);
+      }
+      pos += sizeof(T);
+   }
+
+   template<typename T>
+   void store(unsigned char*& pos, const T& field)
+   {
+      if constexpr (std::is_integral_v<T> && sizeof(T) > 1) {
+         T tmp = hton(field);
+         std::memcpy(pos, &tmp, sizeof(T));
+      } else {
+         std::memcpy(pos, &field, sizeof(T));
+      }
+      pos += sizeof(T);
+   }
+   // ------------------------------------------------------------------------
+   /// The fixed-size fields at the start of a message in the order they are sent, integers in network byte order
+   template<typename... Fields>
+   struct Layout {
+      static constexpr size_t SIZE = (sizeof(Fields) + ...);
+
+      /// Reads the fields from a packet of at least SIZE bytes
+      static std::tuple<Fields...> read(const unsigned char* packet)
+      {
+         std::tuple<Fields...> fields;
+         std::apply([&](auto&... field) { (load(packet, field), ...); }, fields);
+         return fields;
+      }
+
+      /// Writes the fields to a packet of at least SIZE bytes, returns the end of the fields
+      static unsigned char* write(unsigned char* packet, const Fields&... fields)
+      {
+         (store(packet, fields), ...);
+         return packet;
+      }
+   };
+   // ------------------------------------------------------------------------
+   template<typename MsgType>
+   Bytes bytes(const Message<MsgType>& msg)
+   {
+      return {msg.packet, msg.header.size};
+   }
+
+   /// Starts a message with its fixed-size fields, the variable-size part is appended to msg.packet + msg.header.size
+   template<typename L, typename MsgType, typename... Fields>
+   void encode(Message<MsgType>& msg, MsgType type, const Fields&... fields)
+   {
+      msg.header.type = type;
+      msg.header.size = L::write(msg.packet, type, fields...) - msg.packet;
+   }
+
+   /// Appends bytes that fit into the packet
+   template<typename MsgType>
+   void append(Message<MsgType>& msg, Bytes data)
+   {
+      std::memcpy(&msg.packet[msg.header.size], data.data(), data.size());
+      msg.header.size += data.size();
+   }
+
+   /// Appends a string of at most MAX_FILENAME_SIZE characters and its terminating NUL
+   template<typename MsgType>
+   void append(Message<MsgType>& msg, std::string_view str)
+   {
+      std::memcpy(&msg.packet[msg.header.size], str.data(), str.size());
+      msg.packet[msg.header.size + str.size()] = '\0';
+      msg.header.size += str.size() + 1;
+   }
+
+   /// The filename that ends a message, it is NUL-terminated and does not contain another NUL
+   inline std::optional<std::string_view> filename(Bytes rest)
+   {
+      if (rest.empty() || rest.size() > MAX_FILENAME_SIZE + 1 || rest.back() != '\0') return std::nullopt;
+
+      std::string_view name(reinterpret_cast<const char*>(rest.data()), rest.size() - 1);
+      if (name.find('\0') != std::string_view::npos) return std::nullopt;
+      return name;
+   }
+   // ------------------------------------------------------------------------
+   // Client messages
+   // ------------------------------------------------------------------------
+   struct FileRequest {
+      using Fields = Layout<ClientMsgType>;
+
+      std::string_view filename;
+
+      static std::optional<FileRequest> parse(Bytes packet)
+      {
+         if (packet.size() < Fields::SIZE) return std::nullopt;
+         auto name = wire::filename(packet.subspan(Fields::SIZE));
+         if (!name) return std::nullopt;
+         return FileRequest{*name};
+      }
+
+      static void encode(Message<ClientMsgType>& msg, std::string_view filename)
+      {
+         wire::encode<Fields>(msg, FILE_REQUEST);
+         append(msg, filename);
+      }
+   };
+   // ------------------------------------------------------------------------
+   struct ValidationResponse {
+      using Fields = Layout<ClientMsgType, Hash, uint32_t, uint16_t, uint8_t>;
+      static_assert(Fields::SIZE + 1 == CLIENT_VALIDATION_RESPONSE_META_DATA_SIZE);
+
+      Hash hash1;
+      uint32_t nonce;
+      uint16_t maxThroughput;
+      uint8_t capabilities;
+      std::string_view filename;
+
+      static std::optional<ValidationResponse> parse(Bytes packet)
+      {
+         if (packet.size() < Fields::SIZE) return std::nullopt;
+         auto name = wire::filename(packet.subspan(Fields::SIZE));
+         if (!name) return std::nullopt;
+         auto [type, hash1, nonce, maxThroughput, capabilities] = Fields::read(packet.data());
+         return ValidationResponse{hash1, nonce, maxThroughput, capabilities, *name};
+      }
+
+      static void encode(Message<ClientMsgType>& msg, const Hash& hash1, uint32_t nonce, uint16_t maxThroughput, uint8_t capabilities, std::string_view filename)
+      {
+         wire::encode<Fields>(msg, CLIENT_VALIDATION_RESPONSE, hash1, nonce, maxThroughput, capabilities);
+         append(msg, filename);
+      }
+   };
+   // ------------------------------------------------------------------------
+   struct TransmissionRequest {
+      using Fields = Layout<ClientMsgType, ConnectionID, uint8_t, uint32_t, uint32_t, uint16_t, uint32_t>;
+
+      ConnectionID connectionId;
+      uint8_t windowId;
+      /// Smoothed RTT of the client in microseconds
+      uint32_t rtt;
+      /// Absolute index of the first chunk of the window
+      uint32_t chunkIdx;
+      /// Chunks of the last window that did not arrive with its first transmission
+      uint16_t chunksLost;
+      /// Chunks the window may have at most, 0 places no limit
+      uint32_t chunkCount;
+
+      static std::optional<TransmissionRequest> parse(Bytes packet)
+      {
+         if (packet.size() != Fields::SIZE) return std::nullopt;
+         auto [type, connectionId, windowId, rtt, chunkIdx, chunksLost, chunkCount] = Fields::read(packet.data());
+         return TransmissionRequest{connectionId, windowId, rtt, chunkIdx, chunksLost, chunkCount};
+      }
+
+      static void encode(Message<ClientMsgType>& msg, ConnectionID connectionId, uint8_t windowId, uint32_t rtt, uint32_t chunkIdx, uint16_t chunksLost,
+                         uint32_t chunkCount)
+      {
+         wire::encode<Fields>(msg, TRANSMISSION_REQUEST, connectionId, windowId, rtt, chunkIdx, chunksLost, chunkCount);
+      }
+   };
+   // ------------------------------------------------------------------------
+   struct RetransmissionRequest {
+      using Fields = Layout<ClientMsgType, ConnectionID, uint8_t>;
+
+      ConnectionID connectionId;
+      uint8_t windowId;
+      /// Chunks of the window that were received (c.f. Bitfield)
+      Bytes bitfield;
+
+      static std::optional<RetransmissionRequest> parse(Bytes packet)
+      {
+         if (packet.size() < Fields::SIZE) return std::nullopt;
+         auto [type, connectionId, windowId] = Fields::read(packet.data());
+         return RetransmissionRequest{connectionId, windowId, packet.subspan(Fields::SIZE)};
+      }
+
+      /// The bitfield is written to msg.packet + msg.header.size afterwards
+      static void encode(Message<ClientMsgType>& msg, ConnectionID connectionId, uint8_t windowId)
+      {
+         wire::encode<Fields>(msg, RETRANSMISSION_REQUEST, connectionId, windowId);
+      }
+   };
+   // ------------------------------------------------------------------------
+   /// Client Finish Message and Error Connection Not Found
+   template<typename MsgType>
+   struct ConnectionMessage {
+      using Fields = Layout<MsgType, ConnectionID>;
+
+      ConnectionID connectionId;
+
+      static std::optional<ConnectionMessage> parse(Bytes packet)
+      {
+         if (packet.size() != Fields::SIZE) return std::nullopt;
+         auto [type, connectionId] = Fields::read(packet.data());
+         return ConnectionMessage{connectionId};
+      }
+
+      static void encode(Message<MsgType>& msg, MsgType type, ConnectionID connectionId)
+      {
+         wire::encode<Fields>(msg, type, connectionId);
+      }
+   };
+   using FinishMessage = ConnectionMessage<ClientMsgType>;
+   using ConnectionNotFound = ConnectionMessage<ServerMsgType>;
+   // ------------------------------------------------------------------------
+   // Server messages
+   // ------------------------------------------------------------------------
+   struct ValidationRequest {
+      using Fields = Layout<ServerMsgType, uint8_t, Hash, Hash, uint32_t>;
+      static_assert(Fields::SIZE + 1 == SERVER_VALIDATION_REQUEST_META_DATA_SIZE);
+
+      uint8_t difficulty;
+      /// hash1 with the last difficulty bits masked
+      Hash hash1;
+      Hash hash2;
+      uint32_t nonce;
+      std::string_view filename;
+
+      static std::optional<ValidationRequest> parse(Bytes packet)
+      {
+         if (packet.size() < Fields::SIZE) return std::nullopt;
+         auto name = wire::filename(packet.subspan(Fields::SIZE));
+         if (!name) return std::nullopt;
+         auto [type, difficulty, hash1, hash2, nonce] = Fields::read(packet.data());
+         return ValidationRequest{difficulty, hash1, hash2, nonce, *name};
+      }
+
+      static void encode(Message<ServerMsgType>& msg, uint8_t difficulty, const Hash& hash1, const Hash& hash2, uint32_t nonce, std::string_view filename)
+      {
+         wire::encode<Fields>(msg, SERVER_VALIDATION_REQUEST, difficulty, hash1, hash2, nonce);
+         append(msg, filename);
+      }
+   };
+   // ------------------------------------------------------------------------
+   /// Server Initial Response, and the Server Manifest Response, which has the same layout
+   struct InitialResponse {
+      using Fields = Layout<ServerMsgType, ConnectionID, uint64_t, Hash>;
+      static_assert(Fields::SIZE + 1 == SERVER_INITIAL_RESPONSE_META_DATA);
+
+      ConnectionID connectionId;
+      uint64_t fileSize;
+      Hash sha256;
+      std::string_view filename;
+
+      static std::optional<InitialResponse> parse(Bytes packet)
+      {
+         if (packet.size() < Fields::SIZE) return std::nullopt;
+         auto name = wire::filename(packet.subspan(Fields::SIZE));
+         if (!name) return std::nullopt;
+         auto [type, connectionId, fileSize, sha256] = Fields::read(packet.data());
+         return InitialResponse{connectionId, fileSize, sha256, *name};
+      }
+
+      static void encode(Message<ServerMsgType>& msg, ConnectionID connectionId, uint64_t fileSize, const Hash& sha256, std::string_view filename,
+                         ServerMsgType type = SERVER_INITIAL_RESPONSE)
+      {
+         wire::encode<Fields>(msg, type, connectionId, fileSize, sha256);
+         append(msg, filename);
+      }
+   };
+   // ------------------------------------------------------------------------
+   /// Server Data Response and Server Compressed Data Response
+   struct Payload {
+      using Fields = Layout<ServerMsgType, ConnectionID, uint8_t, uint16_t, uint16_t>;
+      static_assert(Fields::SIZE == PAYLOAD_META_DATA_SIZE);
+
+      ConnectionID connectionId;
+      uint8_t windowId;
+      uint16_t windowSize;
+      uint16_t sequenceNumber;
+      /// The chunk, or the compressed consecutive chunks starting at sequenceNumber
+      Bytes data;
+
+      static std::optional<Payload> parse(Bytes packet)
+      {
+         if (packet.size() < Fields::SIZE || packet.size() > Fields::SIZE + CHUNK_SIZE) return std::nullopt;
+         auto [type, connectionId, windowId, windowSize, sequenceNumber] = Fields::read(packet.data());
+         if (sequenceNumber >= windowSize) return std::nullopt;
+         return Payload{connectionId, windowId, windowSize, sequenceNumber, packet.subspan(Fields::SIZE)};
+      }
+
+      /// The data is appended by the caller unless it is given, e.g., compressed directly into the packet
+      static void encode(Message<ServerMsgType>& msg, ServerMsgType type, ConnectionID connectionId, uint8_t windowId, uint16_t windowSize,
+                         uint16_t sequenceNumber, Bytes data = {})
+      {
+         wire::encode<Fields>(msg, type, connectionId, windowId, windowSize, sequenceNumber);
+         append(msg, data);
+      }
+   };
+   // ------------------------------------------------------------------------
+   struct ParityPayload {
+      using Fields = Layout<ServerMsgType, ConnectionID, uint8_t, uint16_t, uint16_t, uint16_t, uint16_t>;
+      static_assert(Fields::SIZE == PARITY_META_DATA_SIZE);
+
+      ConnectionID connectionId;
+      uint8_t windowId;
+      uint16_t windowSize;
+      uint16_t group;
+      uint16_t groups;
+      /// XOR of the lengths of the chunks of the group
+      uint16_t lengths;
+      Bytes parity;
+
+      static std::optional<ParityPayload> parse(Bytes packet)
+      {
+         if (packet.size() < Fields::SIZE || packet.size() > Fields::SIZE + CHUNK_SIZE) return std::nullopt;
+         auto [type, connectionId, windowId, windowSize, group, groups, lengths] = Fields::read(packet.data());
+         if (group >= groups) return std::nullopt;
+         return ParityPayload{connectionId, windowId, windowSize, group, groups, lengths, packet.subspan(Fields::SIZE)};
+      }
+
+      static void encode(Message<ServerMsgType>& msg, ConnectionID connectionId, uint8_t windowId, uint16_t windowSize, uint16_t group, uint16_t groups,
+                         uint16_t lengths, Bytes parity)
+      {
+         wire::encode<Fields>(msg, PARITY_PAYLOAD, connectionId, windowId, windowSize, group, groups, lengths);
+         append(msg, parity);
+      }
+   };
+   // ------------------------------------------------------------------------
+   /// Error File Not Found and Error Client Validation Failed
+   struct FileError {
+      using Fields = Layout<ServerMsgType>;
+      static_assert(Fields::SIZE + 1 == FILE_NOT_FOUND_META_DATA && Fields::SIZE + 1 == CLIENT_VALIDATION_FAILED_META_DATA);
+
+      std::string_view filename;
+
+      static std::optional<FileError> parse(Bytes packet)
+      {
+         if (packet.size() < Fields::SIZE) return std::nullopt;
+         auto name = wire::filename(packet.subspan(Fields::SIZE));
+         if (!name) return std::nullopt;
+         return FileError{*name};
+      }
+
+      static void encode(Message<ServerMsgType>& msg, ServerMsgType type, std::string_view filename)
+      {
+         wire::encode<Fields>(msg, type);
+         append(msg, filename);
+      }
+   };
+}// namespace rft::wire
+// ------------------------------------------------------------------------
+#endif//ROBUST_FILE_TRANSFER_WIRE_HPP
+// ------------------------------------------------------------------------
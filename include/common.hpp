@@ -11,7 +11,8 @@ namespace rft
 {
    using namespace boost::asio;
 
-   using ConnectionID = uint16_t;
+   /// Slot index and generation of the connection on the server (c.f. ConnectionTable)
+   using ConnectionID = uint32_t;
 
    using timepoint = chrono::time_point<boost::asio::chrono::high_resolution_clock>;
    using nanos = chrono::nanoseconds;
@@ -30,7 +31,7 @@ namespace rft
    /// Size of the Server Validation Request meta data (without filename hence)
    const uint16_t SERVER_VALIDATION_REQUEST_META_DATA_SIZE = sizeof(uint8_t) + sizeof(uint8_t) + SHA256_SIZE + SHA256_SIZE + sizeof(uint32_t) + 1;
    /// Size of the Client Validation Response meta data (without filename hence)
-   const uint16_t CLIENT_VALIDATION_RESPONSE_META_DATA_SIZE = sizeof(uint8_t) + SHA256_SIZE + sizeof(uint32_t) + sizeof(uint16_t) + 1;
+   const uint16_t CLIENT_VALIDATION_RESPONSE_META_DATA_SIZE = sizeof(uint8_t) + SHA256_SIZE + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t) + 1;
    /// Size of the Server Initial Response meta data (without filename)
    const uint16_t SERVER_INITIAL_RESPONSE_META_DATA = sizeof(uint8_t) + sizeof(ConnectionID) + sizeof(uint64_t) + SHA256_SIZE + 1;
    /// Size of the Client Validation failed meta data (without filename)
@@ -39,8 +40,14 @@ namespace rft
    const uint16_t FILE_NOT_FOUND_META_DATA = sizeof(uint8_t) + 1;
    /// Size of the Server Payload Packet meta data
    const uint16_t PAYLOAD_META_DATA_SIZE = sizeof(uint8_t) + sizeof(ConnectionID) + sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint16_t);
-   /// Maximum size of a packet (Server Payload Packet aka Server Data Response)
-   const uint16_t MAX_PACKET_SIZE = CHUNK_SIZE + PAYLOAD_META_DATA_SIZE;
+   /// Maximum number of chunks in a Server Compressed Data Response (its meta data is the same as the Server Payload Packet's)
+   const uint16_t MAX_COMPRESSED_CHUNKS = 64;
+   /// Size of the Server Parity Packet meta data
+   const uint16_t PARITY_META_DATA_SIZE = sizeof(uint8_t) + sizeof(ConnectionID) + sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint16_t) + sizeof(uint16_t);
+   /// Maximum size of a packet (Server Parity Packet aka Server Parity Response)
+   const uint16_t MAX_PACKET_SIZE = CHUNK_SIZE + PARITY_META_DATA_SIZE;
+   /// Longest filename that fits into every message carrying it (the Server Validation Request has the most meta data)
+   const uint16_t MAX_FILENAME_SIZE = MAX_PACKET_SIZE - SERVER_VALIDATION_REQUEST_META_DATA_SIZE;
 }// namespace rft
 // ------------------------------------------------------------------------
 #endif//ROBUST_FILE_TRANSFER_COMMON_HPP
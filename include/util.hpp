@@ -2,14 +2,18 @@
 #define ROBUST_FILE_TRANSFER_UTIL_HPP
 // ------------------------------------------------------------------------
 #include "common.hpp"
-#include <random>
 #include <string>
 // ------------------------------------------------------------------------
 namespace rft
 {
    void compute_file_SHA256(std::string& filename, unsigned char ret[SHA256_SIZE]);
+   /// Hashes an open file from its start without moving its offset
+   void compute_file_SHA256(int fd, unsigned char ret[SHA256_SIZE]);
    void compute_SHA256(unsigned char* buffer, size_t size, unsigned char ret[SHA256_SIZE]);
 
+   /// Reads up to size bytes at offset, retrying short reads, returns the number of bytes read, which is less only at the end of the file or on an error
+   size_t read_at(int fd, uint64_t offset, void* buffer, size_t size);
+
    // https://gist.github.com/ccbrown/9722406
    void hexdump(const void* data, size_t size);
 
@@ -19,8 +23,6 @@ namespace rft
       NOT_LOST,
    };
 
-   double random();
-
    template<std::integral T>
    T hton(T i)
    {
@@ -1,5 +1,6 @@
 #include "Client.hpp"
 #include "Server.hpp"
+#include "Trace.hpp"
 #include <boost/program_options.hpp>
 #include <iostream>
 #include <plog/Appenders/ColorConsoleAppender.h>
@@ -21,10 +22,23 @@ int main(int argc, char* argv[])
    size_t port;
    double p;
    double q;
+   double delay;
+   double jitter;
+   rft::LinkConfig link;
+   uint64_t seed;
    string dest;
    vector<string> files;
    bool is_server = false;
    bool is_client = false;
+   bool useReputation = false;
+   bool zeroCopy = false;
+   size_t cacheSize;
+   uint8_t capabilities = 0;
+   bool useDelta = false;
+   bool directIo = false;
+   string cacheDir;
+   string metricsFile;
+   string traceFile;
 
    try {
       po::options_description desc{"Usage"};
@@ -32,10 +46,27 @@ int main(int argc, char* argv[])
       desc.add_options()
          ("help,h", "produce help message")
          ("s", "operate in server mode")
+         ("reputation", "raise the client validation difficulty for sources sending many file requests (server mode)")
+         ("cache-size", po::value(&cacheSize)->default_value(64), "memory in MiB for blocks of served files shared by all connections, 0 disables the cache (server mode)")
+         ("zerocopy", "send cached chunks with MSG_ZEROCOPY instead of copying them into the socket buffer (server mode)")
+         ("fec", "ask the server for parity chunks to recover lost chunks without retransmission (client mode)")
+         ("compress", "ask the server to compress chunks (client mode)")
+         ("delta", "only transfer the blocks of a file that differ from its copy at the destination (client mode)")
+         ("direct", "write received files with O_DIRECT, bypassing the page cache, e.g., for huge transfers (client mode)")
+         ("cache", po::value(&cacheDir), "directory of a block cache shared by all transferred files, only missing blocks are transferred (client mode)")
+         ("metrics", po::value(&metricsFile), "file the metrics are written to every second in the Prometheus text format")
+         ("trace", po::value(&traceFile), "file a binary trace of all packets and congestion control decisions is written to, c.f. rft_trace")
          ("host", po::value(&host),"the hostname to request from (hostname or IPv4 address)")
          ("t", po::value(&port)->default_value(8080), "the port number to use")
          ("p", po::value(&p), "packet loss probability")
          ("q", po::value(&q), "packets remain lost probability")
+         ("delay", po::value(&delay)->default_value(0), "one-way delay in milliseconds of sent packets")
+         ("jitter", po::value(&jitter)->default_value(0), "maximum random delay in milliseconds added to the one-way delay")
+         ("reorder", po::value(&link.reorder)->default_value(0), "probability a sent packet is held back behind the following ones")
+         ("duplicate", po::value(&link.duplicate)->default_value(0), "probability a sent packet is delivered twice")
+         ("bandwidth", po::value(&link.bandwidth)->default_value(0), "bytes per second that are sent, 0 is unlimited")
+         ("queue-limit", po::value(&link.queueLimit)->default_value(0), "packets waiting for the bandwidth before further ones are dropped, 0 is unlimited")
+         ("seed", po::value(&seed), "seed of the emulated link, so that losses and delays are reproducible")
          ("files", po::value<vector<string>>()->multitoken(), "files to transfer")
          ("dest", po::value(&dest)->default_value("/tmp"), "the destination of the transferred files");
       // clang-format on
@@ -75,6 +106,8 @@ int main(int argc, char* argv[])
             throw std::logic_error{"Cannot specify files in server mode"};
          }
          is_server = true;
+         useReputation = vm.count("reputation");
+         zeroCopy = vm.count("zerocopy");
          cout << "Server mode" << endl;
       }
 
@@ -90,6 +123,10 @@ int main(int argc, char* argv[])
          cout << endl;
 
          is_client = true;
+         if (vm.count("fec")) capabilities |= rft::CAPABILITY_FEC;
+         if (vm.count("compress")) capabilities |= rft::CAPABILITY_COMPRESSION;
+         useDelta = vm.count("delta");
+         directIo = vm.count("direct");
          cout << "Client mode with host: " << vm["host"].as<string>() << endl;
       }
 
@@ -110,22 +147,32 @@ int main(int argc, char* argv[])
 
       cout << "p: " << p << "\tq: " << q << endl;
 
+      link.p = p;
+      link.q = q;
+      link.delay = rft::micros(static_cast<int64_t>(delay * 1000));
+      link.jitter = rft::micros(static_cast<int64_t>(jitter * 1000));
+      if (vm.count("seed")) link.seed = seed;
+
       cout << "File destination: " << dest << endl;
 
    } catch (const exception& ex) {
       cerr << ex.what() << endl;
    }
 
+   if (!traceFile.empty() && !rft::trace::open(traceFile)) {
+      PLOG_ERROR << "Could not create trace file: " << traceFile;
+   }
+
    if (is_server) {
       try {
-         rft::Server server(port, p, q);
+         rft::Server server(port, link, useReputation, cacheSize * 1024 * 1024, zeroCopy, metricsFile);
          server.start();
       } catch (std::exception& e) {
          PLOG_ERROR << e.what();
       }
    } else if (is_client) {
       try {
-         rft::Client client(host, port, dest, p, q);
+         rft::Client client(host, port, dest, link, capabilities, useDelta, directIo, cacheDir, metricsFile);
          client.request_files(files);
       } catch (std::exception& e) {
          PLOG_ERROR << e.what();
@@ -134,5 +181,6 @@ int main(int argc, char* argv[])
       PLOG_ERROR << "ERROR: Program neither run in server nor in client mode!";
    }
 
+   rft::trace::close();
    return 0;
 }
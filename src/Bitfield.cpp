@@ -1,64 +1,108 @@
 // ------------------------------------------------------------------------
 #include "Bitfield.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <bit>
 #include <cstring>
 // ------------------------------------------------------------------------
 namespace rft
 {
    Bitfield::Bitfield(uint16_t size) : size(size)
    {
-      bitfield.resize((size + (8 - 1)) / 8, 0);
+      words.resize((size + (64 - 1)) / 64, 0);
    }
    // ------------------------------------------------------------------------
-   Bitfield::BitReference Bitfield::operator[](uint16_t idx)
+   void Bitfield::from(const unsigned char* payload, size_t length)
    {
-      uint16_t byte = idx / 8;
-      uint16_t offset = idx % 8;
-      return {bitfield[byte], offset};
+      length = std::min<size_t>(length, byte_size(size));
+
+      for (size_t w = 0; w < words.size(); ++w) {
+         size_t offset = w * sizeof(uint64_t);
+         uint64_t word = 0;
+         if (offset + sizeof(uint64_t) <= length) {
+            std::memcpy(&word, payload + offset, sizeof(uint64_t));
+         } else if (offset < length) {
+            std::memcpy(&word, payload + offset, length - offset);
+         }
+         words[w] = ntoh(word);
+      }
+
+      // ignore trailing bits beyond the size of the bitfield
+      if (size % 64 != 0) {
+         words.back() &= ~0ULL << (64 - size % 64);
+      }
    }
    // ------------------------------------------------------------------------
-   bool Bitfield::operator[](uint16_t idx) const
+   void Bitfield::to(unsigned char* payload, uint16_t bits) const
    {
-      uint16_t byte = idx / 8;
-      uint16_t offset = idx % 8;
-      unsigned char mask = bitfield[byte];
-      mask &= 1UL << (8 - offset - 1);
-      return static_cast<bool>(mask >> (8 - offset - 1));
+      bits = std::min(bits, size);
+      const size_t length = byte_size(bits);
+
+      for (size_t w = 0; w * sizeof(uint64_t) < length; ++w) {
+         size_t offset = w * sizeof(uint64_t);
+         uint64_t word = words[w];
+         if (bits < (w + 1) * 64) {
+            // do not leak bits beyond the requested number of bits
+            word &= ~(~0ULL >> (bits - w * 64));
+         }
+         word = hton(word);
+         std::memcpy(payload + offset, &word, std::min(sizeof(uint64_t), length - offset));
+      }
    }
    // ------------------------------------------------------------------------
-   void Bitfield::from(std::vector<bool>& sequenceNumbers)
+   bool Bitfield::set(uint16_t idx)
    {
-      for (size_t i = 0; i < size; ++i) {
-         this->operator[](i) = sequenceNumbers[i];
-      }
+      uint64_t& word = words[idx / 64];
+      uint64_t mask = 1ULL << (64 - idx % 64 - 1);
+      bool wasSet = word & mask;
+      word |= mask;
+      return !wasSet;
    }
    // ------------------------------------------------------------------------
-   void Bitfield::from(unsigned char* payload)
+   void Bitfield::reset()
    {
-      std::memcpy(bitfield.data(), payload, bitfield.size());
+      std::fill(words.begin(), words.end(), 0);
    }
    // ------------------------------------------------------------------------
-   Bitfield::BitReference::BitReference(unsigned char& byte, uint16_t offset) : byte(byte), offset(offset)
-   {}
-   // ------------------------------------------------------------------------
-   Bitfield::BitReference::operator bool() const
+   uint16_t Bitfield::count() const
    {
-      unsigned char mask = byte;
-      mask &= 1UL << (8 - offset - 1);
-      return static_cast<bool>(mask >> (8 - offset - 1));
+      uint16_t count = 0;
+      for (uint64_t word: words) {
+         count += std::popcount(word);
+      }
+      return count;
    }
    // ------------------------------------------------------------------------
-   Bitfield::BitReference& Bitfield::BitReference::operator=(const bool b)
+   uint16_t Bitfield::find_next_unset(uint16_t idx) const
    {
-      unsigned char mask;
-      if (b) {
-         mask = 1UL << (8 - offset - 1);
-         byte |= mask;
-         return *this;
-      } else {
-         mask = ~(1UL << (8 - offset - 1));
-         byte &= mask;
-         return *this;
+      if (idx >= size) return size;
+
+      size_t w = idx / 64;
+      // only consider bits at or after idx in the first word
+      uint64_t missing = ~words[w] & (~0ULL >> (idx % 64));
+      ++w;
+
+      if (missing == 0) {
+         // skip completely received regions four words at a time, the and-reduction vectorizes
+         while (w + 4 <= words.size() && (words[w] & words[w + 1] & words[w + 2] & words[w + 3]) == ~0ULL) {
+            w += 4;
+         }
+         while (w < words.size() && words[w] == ~0ULL) {
+            ++w;
+         }
+         if (w == words.size()) return size;
+         missing = ~words[w];
+         ++w;
       }
+
+      // bits beyond the size are never set, hence the result is clamped to the size
+      size_t pos = (w - 1) * 64 + std::countl_zero(missing);
+      return static_cast<uint16_t>(std::min<size_t>(pos, size));
+   }
+   // ------------------------------------------------------------------------
+   bool Bitfield::operator[](uint16_t idx) const
+   {
+      return words[idx / 64] & (1ULL << (64 - idx % 64 - 1));
    }
    // ------------------------------------------------------------------------
 }// namespace rft
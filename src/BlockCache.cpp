@@ -0,0 +1,82 @@
+// ------------------------------------------------------------------------
+#include "BlockCache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+#include <vector>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   BlockCache::BlockCache(const std::string& directory) : directory(directory)
+   {
+      std::filesystem::create_directories(this->directory);
+   }
+   // ------------------------------------------------------------------------
+   bool BlockCache::contains(const Manifest::Block& block) const
+   {
+      std::error_code ec;
+      return std::filesystem::is_regular_file(path_of(block), ec);
+   }
+   // ------------------------------------------------------------------------
+   bool BlockCache::load(const Manifest::Block& block, char* data, size_t size) const
+   {
+      std::ifstream file(path_of(block), std::ios::in | std::ios::binary);
+      file.read(data, static_cast<std::streamsize>(size));
+      if (!file || file.peek() != std::ifstream::traits_type::eof()) return false;
+
+      // the cache is not trusted, a block that was damaged or truncated is transferred again
+      unsigned char strong[Manifest::STRONG_SIZE];
+      Manifest::strong_checksum(reinterpret_cast<unsigned char*>(data), size, strong);
+      return std::memcmp(strong, block.strong, Manifest::STRONG_SIZE) == 0;
+   }
+   // ------------------------------------------------------------------------
+   void BlockCache::store_file(const std::string& filename, const Manifest& manifest)
+   {
+      std::ifstream file(filename, std::ios::in | std::ios::binary);
+      std::vector<char> buffer(manifest.blockSize);
+
+      for (size_t i = 0; i < manifest.blocks.size(); ++i) {
+         const auto& block = manifest.blocks[i];
+         if (contains(block)) continue;
+
+         const uint64_t size = std::min<uint64_t>(manifest.blockSize, manifest.fileSize - i * manifest.blockSize);
+         file.seekg(static_cast<std::streamoff>(i) * manifest.blockSize);
+         file.read(buffer.data(), static_cast<std::streamsize>(size));
+         if (!file) return;
+
+         // blocks appear under their name only once they are complete, other clients may share the cache
+         auto path = path_of(block);
+         auto tmp = path;
+         tmp += ".tmp" + std::to_string(getpid());
+
+         std::error_code ec;
+         std::filesystem::create_directories(path.parent_path(), ec);
+         std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+         out.write(buffer.data(), static_cast<std::streamsize>(size));
+         out.close();
+         if (!out) {
+            PLOG_WARNING << "[Client] Could not add block to cache " << directory;
+            std::filesystem::remove(tmp, ec);
+            return;
+         }
+         std::filesystem::rename(tmp, path, ec);
+      }
+   }
+   // ------------------------------------------------------------------------
+   std::filesystem::path BlockCache::path_of(const Manifest::Block& block) const
+   {
+      static constexpr char HEX[] = "0123456789abcdef";
+
+      std::string name(2 * Manifest::STRONG_SIZE, '\0');
+      for (uint8_t i = 0; i < Manifest::STRONG_SIZE; ++i) {
+         name[2 * i] = HEX[block.strong[i] >> 4];
+         name[2 * i + 1] = HEX[block.strong[i] & 0x0F];
+      }
+
+      return directory / name.substr(0, 2) / name;
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
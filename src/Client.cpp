@@ -1,21 +1,41 @@
 // ------------------------------------------------------------------------
 #include "Client.hpp"
 #include "Bitfield.hpp"
-#include <boost/bind/bind.hpp>
+#include "Compression.hpp"
+#include "Log.hpp"
+#include "Manifest.hpp"
+#include "Trace.hpp"
+#include "Wire.hpp"
 #include <boost/multiprecision/cpp_int.hpp>
 #include <csignal>
 #include <filesystem>
+#include <future>
+#include <thread>
 // ------------------------------------------------------------------------
 namespace rft
 {
    // ------------------------------------------------------------------------
-   Client::Client(std::string host, const size_t port, std::string& fileDest, double p, double q)
-       : socket(io_context, ip::udp::endpoint(ip::udp::v4(), port + 1)), host(std::move(host)), port(port), fileDest(std::move(fileDest)), p(p), q(q)
+   Client::Client(std::string host, const size_t port, std::string& fileDest, const LinkConfig& link, uint8_t capabilities, bool useDelta, bool directIo, const std::string& cacheDir,
+                  const std::string& metricsFile)
+       : ownContext(std::make_unique<boost::asio::io_context>()), io_context(*ownContext), socket(make_strand(io_context), ip::udp::endpoint(ip::udp::v4(), port + 1)), link(socket, link),
+         host(std::move(host)), port(port), fileDest(std::move(fileDest)), capabilities(capabilities), useDelta(useDelta), directIo(directIo), metricsFile(metricsFile),
+         metricsTimer(make_strand(io_context))
    {
+      if (!cacheDir.empty()) {
+         cache.emplace(cacheDir);
+      }
       resolve_server();
    }
    // ------------------------------------------------------------------------
-   int Client::abort = 0;
+   Client::Client(boost::asio::io_context& context, const ip::udp::endpoint& server, std::string fileDest, const LinkConfig& link, uint8_t capabilities, bool useDelta,
+                  bool directIo, const std::string& cacheDir, const std::string& metricsFile)
+       : io_context(context), socket(make_strand(io_context), ip::udp::endpoint(ip::udp::v4(), 0)), link(socket, link), host(server.address().to_string()), port(server.port()),
+         server_endpoint(server), fileDest(std::move(fileDest)), capabilities(capabilities), useDelta(useDelta), directIo(directIo), metricsFile(metricsFile), metricsTimer(make_strand(io_context))
+   {
+      if (!cacheDir.empty()) {
+         cache.emplace(cacheDir);
+      }
+   }
    // ------------------------------------------------------------------------
    Client::~Client() { stop(); }
    // ------------------------------------------------------------------------
@@ -25,215 +45,557 @@ namespace rft
          ip::udp::resolver resolver(io_context);
          server_endpoint = *resolver.resolve(ip::udp::v4(), host, std::to_string(port)).begin();
 
-         PLOG_INFO << "[Client] Resolved server at " + server_endpoint.address().to_string() + ":" + std::to_string(server_endpoint.port());
+         PLOG_INFO << "[Client] Resolved server at " << server_endpoint.address().to_string() << ":" << server_endpoint.port();
       } catch (std::exception& e) {
          PLOG_ERROR << "[Client] Error while trying to resolve_server to server";
          throw e;
       }
    }
    // ------------------------------------------------------------------------
-   void Client::start()
+   void Client::start(std::vector<std::string> files, std::function<void()> done)
    {
-      handle_user_termination();
+      started = NOW;
+      onDone = std::move(done);
+
+      std::vector<std::shared_ptr<FileTransfer>> requested;
+      {
+         std::lock_guard lock(transfersMutex);
+         for (auto& file: files) {
+            if (file.size() > MAX_FILENAME_SIZE) {
+               PLOG_ERROR << "[Client] Filename " << file << " is longer than " << MAX_FILENAME_SIZE << " characters";
+               continue;
+            }
+            auto transfer = std::make_shared<FileTransfer>(file, fileDest + "/" + file, make_strand(io_context));
+            // a file that is requested twice is transferred once
+            if (transfers.emplace(file, transfer).second) {
+               requested.push_back(transfer);
+            }
+         }
+      }
+      remaining = requested.size();
 
-      receive_msg();
-      thread_context = std::thread([this]() { io_context.run(); });
+      co_spawn(socket.get_executor(), receive_packets(), [pending = PendingIo(pendingIo)](std::exception_ptr error) {
+         if (error) std::rethrow_exception(error);
+      });
+      if (!metricsFile.empty()) {
+         co_spawn(metricsTimer.get_executor(), export_metrics_periodically(), [pending = PendingIo(pendingIo)](std::exception_ptr error) {
+            if (error) std::rethrow_exception(error);
+         });
+      }
 
-      process_msgs();
-   }
-   // ------------------------------------------------------------------------
-   void Client::stop()
-   {
-      io_context.stop();
-      if (thread_context.joinable()) thread_context.join();
-      PLOG_INFO << "[Client] Disconnected!";
+      if (requested.empty()) {
+         finish();
+         return;
+      }
+      // every file progresses on its own strand, the io_context may be run by several threads
+      for (auto& transfer: requested) {
+         co_spawn(transfer->strand, transfer_file(transfer), [this, transfer, pending = PendingIo(pendingIo)](std::exception_ptr error) {
+            if (error) {
+               try {
+                  std::rethrow_exception(error);
+               } catch (const std::exception& e) {
+                  PLOG_ERROR << "[Client] Transfer of file " << transfer->name << " failed: " << e.what();
+               }
+            }
+            transfer->timer.cancel();
+            {
+               std::lock_guard lock(transfersMutex);
+               transfers.erase(transfer->name);
+            }
+            if (--remaining == 0) {
+               finish();
+            }
+         });
+      }
    }
    // ------------------------------------------------------------------------
    void Client::request_files(std::vector<std::string>& files)
    {
-      for (auto& file: files) {
-         request_file(file);
+      if (!ownContext) {
+         std::promise<void> done;
+         start(files, [&done]() { done.set_value(); });
+         done.get_future().wait();
+         return;
       }
 
-      start();
-   }
-   // ------------------------------------------------------------------------
-   void Client::request_file(std::string filename)
-   {
-      Message<ClientMsgType> msgOut;
-      msgOut.header.type = FILE_REQUEST;
-      msgOut.header.size = 0;
-      msgOut.header.remote = socket.local_endpoint();
-
-      msgOut << FILE_REQUEST;
-      msgOut << filename;
-
-      PLOG_INFO << "[Client] Requesting file: " << filename;
-
-      fileRequests.insert({filename, FileRequest{io_context}});
-
-      auto& fr = fileRequests.at(filename);
-      // Set a long timeout for a file request (calculation of SHA256 can take a while)
-      fr.timer.setTimeout(minutes(10), boost::bind(&Client::handle_file_request_timeout, this, filename));
-      fr.tp = NOW;
+      signals.emplace(io_context, SIGINT);
+      signals->async_wait([this](const boost::system::error_code& error, int) {
+         if (error) return;
+         PLOG_WARNING << "[Client] Aborted file transfer. Deleting all incomplete files!";
+         cancel();
+      });
+      start(files, {});
 
-      send_msg(msgOut);
-   }
-   // ------------------------------------------------------------------------
-   void Client::send_msg(Message<ClientMsgType> msg)
-   {
-      switch (packetLossState) {
-         case PacketLossState::LOST:
-            if (rft::random() < q) {
-               return;
-            }
-            packetLossState = PacketLossState::NOT_LOST;
-            break;
-         case PacketLossState::NOT_LOST:
-            if (rft::random() < p) {
-               packetLossState = PacketLossState::LOST;
-               return;
-            }
-            break;
+      // run() returns once every file is done and the socket is closed
+      std::vector<std::thread> threads(std::max(1u, std::thread::hardware_concurrency()) - 1);
+      for (auto& thread: threads) {
+         thread = std::thread([this]() { io_context.run(); });
+      }
+      io_context.run();
+      for (auto& thread: threads) {
+         thread.join();
       }
-
-      socket.async_send_to(buffer(msg.packet, msg.header.size), server_endpoint,
-                           boost::bind(&Client::handle_send, this,
-                                       boost::asio::placeholders::error,
-                                       boost::asio::placeholders::bytes_transferred));
    }
    // ------------------------------------------------------------------------
-   void Client::handle_send(const boost::system::error_code& error, size_t bytes_transferred)
+   void Client::finish()
    {
-      if (!error) {
-         // PLOG_VERBOSE << "[Client] Send message";
-      } else {
-         PLOG_WARNING << "[Client] Error on Send: " + error.to_string();
+      post(socket.get_executor(), [this, pending = PendingIo(pendingIo)]() {
+         boost::system::error_code error;
+         socket.close(error);
+      });
+      if (signals) {
+         post(io_context, [this, pending = PendingIo(pendingIo)]() { signals->cancel(); });
       }
+      post(metricsTimer.get_executor(), [this, pending = PendingIo(pendingIo)]() {
+         metricsStopped = true;
+         metricsTimer.cancel();
+         if (!metricsFile.empty()) {
+            export_metrics();
+         }
+         if (onDone) onDone();
+      });
    }
    // ------------------------------------------------------------------------
-   void Client::receive_msg()
+   void Client::stop()
    {
-      socket.async_receive_from(buffer(msgIn.packet, MAX_PACKET_SIZE), remote_endpoint,
-                                boost::bind(&Client::handle_receive, this,
-                                            boost::asio::placeholders::error,
-                                            boost::asio::placeholders::bytes_transferred));
+      cancel();
+      if (!ownContext) {
+         // the io_context is shared, pending operations complete with an error once the socket is closed
+         post(socket.get_executor(), [this, pending = PendingIo(pendingIo)]() {
+            boost::system::error_code error;
+            socket.close(error);
+         });
+         post(metricsTimer.get_executor(), [this, pending = PendingIo(pendingIo)]() {
+            metricsStopped = true;
+            metricsTimer.cancel();
+         });
+         std::unique_lock lock(pendingIo.mux);
+         pendingIo.idle.wait(lock, [this]() { return pendingIo.value == 0; });
+      }
+      workers.join();
+      PLOG_INFO << "[Client] Disconnected!";
    }
    // ------------------------------------------------------------------------
-   void Client::handle_receive(const boost::system::error_code& error, size_t bytes_transferred)
+   void Client::cancel()
    {
-      // don't accept more incoming packets if user aborted
-      if (abort == 1) {
-         for (auto& fr: fileRequests) {
-            fr.second.timer.cancel();
-         }
-         for (auto& conn: connections) {
-            conn.second.timer.cancel();
-         }
-         return;
-      }
+      cancelled = true;
 
-      if (!error) {
-         // PLOG_VERBOSE << "[Client] Received message";
-         enqueue_msg(bytes_transferred);
-      } else {
-         PLOG_WARNING << "[Client] Error on Receive: " + error.to_string();
+      std::lock_guard lock(transfersMutex);
+      for (auto& [name, transfer]: transfers) {
+         post(transfer->strand, [transfer, pending = PendingIo(pendingIo)]() { transfer->wake(); });
       }
    }
    // ------------------------------------------------------------------------
-   void Client::enqueue_msg(size_t bytes_transferred)
+   template<typename Function>
+   awaitable<std::invoke_result_t<Function&>> Client::offload(Function function)
    {
-      decode_msg(bytes_transferred);
-      msgQueue.push_back(msgIn);
-
-      receive_msg();
+      co_return co_await co_spawn(workers, [&]() -> awaitable<std::invoke_result_t<Function&>> { co_return function(); }, use_awaitable);
    }
    // ------------------------------------------------------------------------
-   void Client::decode_msg(size_t bytes_transferred)
+   void Client::send_msg(Message<ClientMsgType> msg)
    {
-      auto& msg = msgIn.packet;
-
-      auto msgType = static_cast<ServerMsgType>(msg[0]);
-
-      msgIn.header.type = msgType;
-      msgIn.header.size = bytes_transferred;
-      msgIn.header.remote = remote_endpoint;
+      ++packetsSent;
+      bytesSent += msg.header.size;
+      if (trace::enabled()) trace::packet(trace::Source::CLIENT, trace::EventType::PACKET_SENT, msg.packet, msg.header.size);
+
+      // files send from their own strands, the socket is only used on its strand, where it is also closed
+      auto packet = std::make_shared<Message<ClientMsgType>>(std::move(msg));
+      dispatch(socket.get_executor(), [this, packet, pending = PendingIo(pendingIo)]() {
+         link.send(packet->packet, packet->header.size, server_endpoint, [packet, pending](const boost::system::error_code& error, size_t) {
+            if (error && error != boost::asio::error::bad_descriptor) {
+               RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Client] Error on Send: " << error.message();
+            }
+         });
+      });
    }
    // ------------------------------------------------------------------------
-   void Client::process_msgs()
+   awaitable<void> Client::receive_packets()
    {
-      while (!done) {
-         msgQueue.wait();
-
-         if (abort == 1) {
-            delete_incomplete_files();
-            return;
+      while (true) {
+         Packet msg = packets.acquire();
+         boost::system::error_code error;
+         size_t bytes_transferred = co_await socket.async_receive_from(buffer(msg->packet, MAX_PACKET_SIZE), remote_endpoint, redirect_error(use_awaitable, error));
+         if (error == boost::asio::error::operation_aborted || error == boost::asio::error::bad_descriptor) {
+            co_return;
          }
-
-         while (!msgQueue.empty()) {
-            auto msg = msgQueue.pop_front();
-            dispatch_msg(msg);
+         if (error) {
+            RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Client] Error on Receive: " << error.message();
+            continue;
          }
+
+         msg->header.type = static_cast<ServerMsgType>(msg->packet[0]);
+         msg->header.size = bytes_transferred;
+         msg->header.remote = remote_endpoint;
+         ++packetsReceived;
+         bytesReceived += bytes_transferred;
+         if (trace::enabled()) trace::packet(trace::Source::CLIENT, trace::EventType::PACKET_RECEIVED, msg->packet, bytes_transferred);
+
+         deliver(std::move(msg));
       }
    }
    // ------------------------------------------------------------------------
-   void Client::dispatch_msg(Message<ServerMsgType>& msg)
+   void Client::deliver(Packet packet)
    {
+      const Message<ServerMsgType>& msg = *packet;
+      std::optional<std::string_view> filename;
+      std::optional<ConnectionID> connectionId;
       switch (msg.header.type) {
-         // TODO: Think about which operation should be done on the main thread and which on a separate thread
          case SERVER_VALIDATION_REQUEST:
-            // finding a solution is a time-consuming operation, do not block the main thread for this (otherwise timeouts for file transfers that are already in progress will fire)
-            post(boost::bind(&Client::handle_validation_request, this, msg));
+            if (auto request = wire::ValidationRequest::parse(wire::bytes(msg))) filename = request->filename;
             break;
          case SERVER_INITIAL_RESPONSE:
-            handle_initial_response(msg);
-            break;
-         case PAYLOAD:
-            handle_payload_packet(msg);
+         case SERVER_MANIFEST_RESPONSE:
+            if (auto response = wire::InitialResponse::parse(wire::bytes(msg))) filename = response->filename;
             break;
          case ERROR_FILE_NOT_FOUND:
-            handle_file_not_found(msg);
-            break;
          case ERROR_CLIENT_VALIDATION_FAILED:
-            handle_validation_failed(msg);
+            if (auto error = wire::FileError::parse(wire::bytes(msg))) filename = error->filename;
             break;
+         case PAYLOAD:
+         case COMPRESSED_PAYLOAD:
+         case PARITY_PAYLOAD:
          case ERROR_CONNECTION_NOT_FOUND:
-            handle_connection_not_found(msg);
+            // the packets of a connection start with its ID, they are validated by the file they belong to
+            if (msg.header.size >= wire::Layout<ServerMsgType, ConnectionID>::SIZE) {
+               connectionId = std::get<1>(wire::Layout<ServerMsgType, ConnectionID>::read(msg.packet));
+            }
             break;
          // Ignore unknown packets
          default:
-            PLOG_VERBOSE << "[Client] Dropping unknown packet.";
+            RFT_LOG(plog::verbose) << "[Client] Dropping unknown packet.";
+            return;
+      }
+      if (!filename && !connectionId) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Client] Dropping malformed packet of type " << static_cast<int>(msg.header.type);
+         return;
+      }
+
+      std::shared_ptr<FileTransfer> transfer;
+      {
+         std::lock_guard lock(transfersMutex);
+         if (filename) {
+            auto search = transfers.find(std::string(*filename));
+            if (search != transfers.end()) transfer = search->second;
+         } else {
+            auto search = connections.find(*connectionId);
+            if (search != connections.end()) transfer = search->second;
+         }
+      }
+      if (!transfer) {
+         // a late answer for a file or connection that is done
+         return;
+      }
+
+      switch (transfer->inbox.push(packet)) {
+         case Inbox<Message<ServerMsgType>>::Pushed::DROPPED:
+            RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Client] Dropping packet, the inbox of " << transfer->name << " is full";
+            return;
+         case Inbox<Message<ServerMsgType>>::Pushed::QUEUED:
+            ++queued;
+            return;
+         case Inbox<Message<ServerMsgType>>::Pushed::WAKE:
+            ++queued;
+            post(transfer->strand, [transfer, pending = PendingIo(pendingIo)]() { transfer->wake(); });
             return;
       }
    }
    // ------------------------------------------------------------------------
-   void Client::handle_validation_request(Message<ServerMsgType>& msg)
+   void Client::FileTransfer::wake()
    {
-      using namespace boost::multiprecision;
+      if (!waiter) return;
+      auto resume = std::move(waiter);
+      waiter = nullptr;
+      resume();
+   }
+   // ------------------------------------------------------------------------
+   awaitable<Client::Packet> Client::receive(FileTransfer& transfer, timepoint deadline)
+   {
+      while (!cancelled) {
+         if (Packet msg = transfer.inbox.pop()) {
+            --queued;
+            co_return msg;
+         }
+         if (deadline <= NOW) {
+            co_return nullptr;
+         }
+         // deadlines mostly move forward with every packet, the timer is only armed again for an earlier one
+         if (deadline < transfer.armed) {
+            transfer.armed = deadline;
+            transfer.timer.expires_at(deadline);
+            transfer.timer.async_wait([transfer = transfer.shared_from_this(), pending = PendingIo(pendingIo)](const boost::system::error_code& error) {
+               if (error) return;
+               transfer->armed = timepoint::max();
+               transfer->wake();
+            });
+         }
+         // woken by the next packet for the file, the inbox was marked waiting when it was found empty, by the timer, or by cancel()
+         co_await async_initiate<decltype(use_awaitable), void()>(
+               [&transfer](auto handler) {
+                  auto resume = std::make_shared<decltype(handler)>(std::move(handler));
+                  transfer.waiter = [resume]() { dispatch(std::move(*resume)); };
+               },
+               use_awaitable);
+      }
+      co_return nullptr;
+   }
+   // ------------------------------------------------------------------------
+   awaitable<void> Client::transfer_file(std::shared_ptr<FileTransfer> transfer)
+   {
+      const std::string& dest = transfer->dest;
+      // the blocks of a local copy or of the cache are reused, the manifest is asked for along with the file
+      std::error_code ec;
+      const bool reuse = cache || (useDelta && std::filesystem::is_regular_file(dest, ec));
+      auto response = co_await handshake(*transfer, reuse);
+      if (!response) co_return;
+
+      std::string basis;
+      if (useDelta && std::filesystem::is_regular_file(dest, ec)) {
+         basis = dest + ".basis";
+         std::rename(dest.c_str(), basis.c_str());
+      }
 
-      auto end = NOW;
+      while (true) {
+         Connection conn(dest, *response, directIo);
+         conn.basis = basis;
+         if (!conn.file) {
+            PLOG_ERROR << "[Client] Could not open file " << dest << " for writing.";
+            if (!basis.empty()) {
+               std::rename(basis.c_str(), dest.c_str());
+            }
+            send_finish_msg(conn.connectionId);
+            co_return;
+         }
+         register_connection(*transfer, conn.connectionId);
 
-      uint32_t filenameSize = msg.header.size - SERVER_VALIDATION_REQUEST_META_DATA_SIZE;
-      uint8_t difficulty;
-      unsigned char hash1[SHA256_SIZE];
-      unsigned char hash2[SHA256_SIZE];
-      uint32_t nonce;
-      std::string filename(filenameSize, '\0');
+         if (response->manifest) {
+            // the transfer starts once the blocks that can be reused are known
+            co_await fetch_manifest(*transfer, conn, *response->manifest);
+         }
 
-      msg >> filename;
-      msg >> nonce;
-      msg >> hash2;
-      msg >> hash1;
-      msg >> difficulty;
+         Outcome outcome;
+         while ((outcome = co_await receive_windows(*transfer, conn)) == Outcome::CONNECTION_NOT_FOUND) {
+            unregister_connection(*transfer, conn.connectionId);
+            // the manifest is needed if the file changed, which is only known from the answer
+            response = co_await handshake(*transfer, cache || useDelta);
+            if (!response || response->sha256 != conn.sha256) break;
 
-      auto duration = chrono::duration_cast<timeunit>(end - fileRequests.at(filename).tp);
-      ++rttCount;
-      rttCurrent = duration.count();
-      rttTotal += rttCurrent;
+            // file not changed, the connection continues under its new ID
+            if (response->manifest) {
+               send_finish_msg(response->manifest->connectionId);
+            }
+            conn.connectionId = response->connectionId;
+            register_connection(*transfer, conn.connectionId);
+         }
+         unregister_connection(*transfer, conn.connectionId);
+
+         switch (outcome) {
+            case Outcome::COMPLETE:
+               // the only sync of the file
+               if (!co_await offload([&] { return conn.file.close(true); })) {
+                  PLOG_WARNING << "[Client] Could not write to file " << dest;
+                  discard(conn);
+                  send_finish_msg(conn.connectionId);
+                  co_return;
+               }
+               if (!verify(conn)) {
+                  PLOG_ERROR << "[Client] File " << dest << " was not transferred successfully (wrong SHA256 checksum)\nPlease request file again!";
+                  discard(conn);
+                  co_return;
+               }
+
+               if (!conn.basis.empty()) {
+                  std::remove(conn.basis.c_str());
+               }
+               if (!conn.manifest.blocks.empty()) {
+                  PLOG_INFO << "[Client] Reused " << conn.bytesCopied << "B of " << conn.fileSize << "B of " << dest << " from local copies";
+                  if (cache) {
+                     co_await offload([&] {
+                        std::lock_guard lock(cacheMutex);
+                        cache->store_file(dest, conn.manifest);
+                     });
+                  }
+               }
+
+               PLOG_INFO << "[Client] Transferred file " << dest << " successfully";
+               report_progress(conn, true);
+               {
+                  std::lock_guard lock(statsMutex);
+                  ++stats.filesTransferred;
+                  stats.bytesCopied += conn.bytesCopied;
+                  stats.completionTimes.push_back(chrono::duration_cast<timeunit>(NOW - started));
+               }
+               send_finish_msg(conn.connectionId);
+               co_return;
+            case Outcome::CONNECTION_NOT_FOUND:
+               if (!response) {
+                  discard(conn);
+                  co_return;
+               }
+               // file changed, the part that was transferred already may still share blocks with the new version
+               co_await offload([&] { return conn.file.close(false); });
+               if (!conn.basis.empty()) {
+                  std::remove(dest.c_str());
+               } else if (useDelta) {
+                  basis = dest + ".basis";
+                  std::rename(dest.c_str(), basis.c_str());
+               } else {
+                  std::remove(dest.c_str());
+               }
+               break;
+            case Outcome::CANCELLED:
+               PLOG_WARNING << "[Client] Deleting incomplete file " << dest;
+               discard(conn);
+               // Specification says that a Client Connection Termination message should be sent.
+               // In hindsight, there is no need for that message as the Client Finish Message can be used instead (the server does not need to know why the client terminated/finished)
+               send_finish_msg(conn.connectionId);
+               co_return;
+            case Outcome::WRITE_FAILED:
+               discard(conn);
+               send_finish_msg(conn.connectionId);
+               co_return;
+            case Outcome::DISCONNECTED:
+               discard(conn);
+               co_return;
+         }
+      }
+   }
+   // ------------------------------------------------------------------------
+   awaitable<std::optional<Client::Handshake>> Client::handshake(FileTransfer& transfer, bool manifest)
+   {
+      const timepoint requested = NOW;
+      RttEstimator rtt;
+      uint8_t retryCounter = 1;
+      const uint8_t maxRetries = 10;
+
+      PLOG_INFO << "[Client] Requesting file: " << transfer.name;
+
+      Message<ClientMsgType> request;
+      wire::FileRequest::encode(request, transfer.name);
+      // the server answers without touching the file, so the request is repeated after the (backed off) initial RTO
+      timepoint tp = NOW;
+      auto deadline = tp + rtt.rto();
+      send_msg(request);
+
+      // set once the puzzle of the server is solved
+      std::optional<Message<ClientMsgType>> validation;
+      // the Server Manifest Response is sent ahead of the Server Initial Response, but may be reordered behind it
+      std::shared_ptr<Handshake> offer;
+      std::optional<Handshake> initial;
+      while (true) {
+         auto msg = co_await receive(transfer, deadline);
+         if (!msg) {
+            if (cancelled) co_return std::nullopt;
+            if (initial) {
+               PLOG_WARNING << "[Client] Got no manifest for " << transfer.name << ", transferring the whole file";
+               co_return initial;
+            }
+
+            if (retryCounter >= maxRetries) {
+               if (validation) {
+                  PLOG_ERROR << "[Client] Sent validation response for " << transfer.name << " multiple times without success.";
+               } else {
+                  PLOG_ERROR << "[Client] Requested file " << transfer.name << " multiple times without success.";
+               }
+               co_return std::nullopt;
+            }
+
+            ++retryCounter;
+            {
+               std::lock_guard lock(statsMutex);
+               ++stats.timeouts;
+            }
+            if (validation) {
+               PLOG_INFO << "[Client] Repeating validation response for file : " << transfer.name;
+               deadline = NOW + minutes(1);
+               send_msg(*validation);
+            } else {
+               PLOG_INFO << "[Client] Repeating request for file: " << transfer.name;
+               rtt.backoff();
+               if (trace::enabled()) trace::record(trace::Source::CLIENT, trace::EventType::TIMEOUT, 0, trace::FILE_REQUEST_TIMEOUT);
+               tp = NOW;
+               deadline = tp + rtt.rto();
+               send_msg(request);
+            }
+            continue;
+         }
 
-      PLOG_INFO << "[Client] Got Validation Request for file: " << filename;
+         switch (msg->header.type) {
+            case SERVER_VALIDATION_REQUEST: {
+               if (validation) {
+                  // the answer to a repeated File Request
+                  break;
+               }
+               auto end = NOW;
+               auto puzzle = wire::ValidationRequest::parse(wire::bytes(*msg));
+               if (!puzzle) break;
+
+               // Karn's algorithm: the response to a repeated request cannot be matched to the request it answers
+               if (retryCounter == 1) {
+                  rtt.addSample(chrono::duration_cast<timeunit>(end - tp));
+               }
+
+               PLOG_INFO << "[Client] Got Validation Request for file: " << transfer.name;
+
+               // finding a solution is a time-consuming operation, it must not hold up the packets of the other files
+               const uint8_t difficulty = puzzle->difficulty;
+               const uint32_t nonce = puzzle->nonce;
+               const wire::Hash hash1 = puzzle->hash1;
+               const wire::Hash hash2 = puzzle->hash2;
+               wire::Hash solution = co_await offload([&] { return solve_puzzle(difficulty, hash1, hash2); });
+
+               validation.emplace();
+               wire::ValidationResponse::encode(*validation, solution, nonce, MAX_THROUGHPUT, manifest ? capabilities | CAPABILITY_MANIFEST : capabilities, transfer.name);
+               retryCounter = 1;
+               // Set a reasonably long timeout to validate the solution
+               deadline = NOW + minutes(1);
+               send_msg(*validation);
+               break;
+            }
+            case SERVER_MANIFEST_RESPONSE: {
+               auto response = wire::InitialResponse::parse(wire::bytes(*msg));
+               if (!validation || !response || offer) break;
+               offer = std::make_shared<Handshake>(Handshake{response->connectionId, response->fileSize, response->sha256, rtt, nullptr});
+               if (initial) {
+                  initial->manifest = offer;
+                  co_return initial;
+               }
+               break;
+            }
+            case SERVER_INITIAL_RESPONSE: {
+               auto response = wire::InitialResponse::parse(wire::bytes(*msg));
+               if (!validation || !response || initial) break;
+               handshakeLatency.observe(chrono::duration<double>(NOW - requested).count());
+
+               PLOG_INFO << "[Client] Got Initial response for file: " << transfer.name;
+
+               // no sample is taken here, the response includes the time the server needs to compute the checksum of the file
+               initial = Handshake{response->connectionId, response->fileSize, response->sha256, rtt, offer};
+               if (!manifest || offer || response->fileSize < Manifest::MIN_BLOCK_SIZE) {
+                  co_return initial;
+               }
+               // the server sent the manifest first, it is waited for about a round trip in case it was reordered
+               deadline = NOW + rtt.rto();
+               break;
+            }
+            case ERROR_FILE_NOT_FOUND:
+               PLOG_WARNING << "[Client] File " << transfer.name << " not found on server!";
+               co_return std::nullopt;
+            case ERROR_CLIENT_VALIDATION_FAILED:
+               PLOG_WARNING << "[Client] Validation failed for file " << transfer.name << "\nYou might want to retry the file transfer!";
+               co_return std::nullopt;
+            default:
+               // late packets of an earlier connection of the file
+               break;
+         }
+      }
+   }
+   // ------------------------------------------------------------------------
+   wire::Hash Client::solve_puzzle(uint8_t difficulty, const wire::Hash& hash1, const wire::Hash& hash2)
+   {
+      using namespace boost::multiprecision;
 
       // find a solution by converting to and from 256 wide ints
+      wire::Hash solution{};
       unsigned char candidate[SHA256_SIZE];
       unsigned char candidate_hash[SHA256_SIZE];
       uint256_t bigint;
@@ -244,209 +606,340 @@ namespace rft
          export_bits(tmp, std::begin(candidate), 8);
          compute_SHA256(candidate, SHA256_SIZE, candidate_hash);
 
-         if (std::strncmp(reinterpret_cast<char*>(hash2), reinterpret_cast<char*>(candidate_hash), SHA256_SIZE) == 0) {
+         if (std::memcmp(hash2.data(), candidate_hash, SHA256_SIZE) == 0) {
             // found a solution
-            auto& fr = fileRequests.at(filename);
-            std::memcpy(fr.hash1Solution, candidate, SHA256_SIZE);
-            fr.nonce = nonce;
+            std::memcpy(solution.data(), candidate, SHA256_SIZE);
             break;
          }
       }
-
-      Message<ClientMsgType> msgOut;
-      msgOut.header.type = CLIENT_VALIDATION_RESPONSE;
-      msgOut.header.size = 0;
-      msgOut.header.remote = socket.local_endpoint();
-
-      msgOut << CLIENT_VALIDATION_RESPONSE;
-      msgOut << candidate;
-      msgOut << nonce;
-      msgOut << MAX_THROUGHPUT;
-      msgOut << filename;
-
-      auto& fr = fileRequests.at(filename);
-      fr.retryCounter = 1;
-      // Set a reasonably long timeout to validate the solution
-      fr.timer.setTimeout(minutes(1), boost::bind(&Client::handle_validation_response_timeout, this, filename));
-      fr.tp = NOW;
-
-      send_msg(msgOut);
+      return solution;
    }
    // ------------------------------------------------------------------------
-   void Client::handle_initial_response(Message<ServerMsgType>& msg)
+   awaitable<void> Client::fetch_manifest(FileTransfer& transfer, Connection& conn, const Handshake& offer)
    {
-      auto end = NOW;
-
-      size_t filenameSize = msg.header.size - SERVER_INITIAL_RESPONSE_META_DATA;
+      Connection manifest(conn.filename + ".manifest", offer, false);
+      manifest.isManifest = true;
+      if (!manifest.file) {
+         PLOG_ERROR << "[Client] Could not open file " << manifest.filename << " for writing.";
+         send_finish_msg(manifest.connectionId);
+         co_return;
+      }
 
-      ConnectionID connectionId;
-      uint64_t fileSize;
-      unsigned char sha256[SHA256_SIZE];
-      std::string filename(filenameSize, '\0');
+      register_connection(transfer, manifest.connectionId);
+      // the manifest is not resumed, it is small compared to the file
+      auto outcome = co_await receive_windows(transfer, manifest);
+      unregister_connection(transfer, manifest.connectionId);
+      register_connection(transfer, conn.connectionId);
 
-      msg >> filename;
-      msg >> sha256;
-      msg >> fileSize;
-      msg >> connectionId;
+      const bool verified = outcome == Outcome::COMPLETE && co_await offload([&] { return manifest.file.close(false); }) && verify(manifest);
+      if (outcome != Outcome::DISCONNECTED && outcome != Outcome::CONNECTION_NOT_FOUND) {
+         send_finish_msg(manifest.connectionId);
+      }
+      if (!verified) {
+         if (outcome == Outcome::COMPLETE) {
+            PLOG_ERROR << "[Client] File " << manifest.filename << " was not transferred successfully (wrong SHA256 checksum)";
+         }
+         std::remove(manifest.filename.c_str());
+         if (!cancelled) {
+            PLOG_WARNING << "[Client] Could not obtain the manifest for " << conn.filename << ", transferring the whole file";
+         }
+         co_return;
+      }
 
-      auto duration = chrono::duration_cast<timeunit>(end - fileRequests.at(filename).tp);
-      ++rttCount;
-      rttCurrent = duration.count();
-      rttTotal += rttCurrent;
+      auto blocks = co_await offload([&] { return Manifest::read(manifest.filename); });
+      std::remove(manifest.filename.c_str());
+      if (!blocks || blocks->fileSize != conn.fileSize) {
+         PLOG_WARNING << "[Client] Manifest for " << conn.filename << " is malformed, transferring the whole file";
+         co_return;
+      }
+      conn.manifest = std::move(*blocks);
+
+      // matching reads the whole basis
+      size_t cached = co_await offload([&] {
+         conn.blockOffsets = conn.basis.empty() ? std::vector<int64_t>(conn.manifest.blocks.size(), -1) : conn.manifest.match(conn.basis);
+
+         size_t cached = 0;
+         std::lock_guard lock(cacheMutex);
+         for (size_t i = 0; cache && i < conn.blockOffsets.size(); ++i) {
+            if (conn.blockOffsets[i] < 0 && cache->contains(conn.manifest.blocks[i])) {
+               conn.blockOffsets[i] = Connection::BLOCK_CACHED;
+               ++cached;
+            }
+         }
+         return cached;
+      });
+      size_t found = std::count_if(conn.blockOffsets.begin(), conn.blockOffsets.end(), [](int64_t offset) { return offset >= 0; });
+      PLOG_INFO << "[Client] Found " << found << " of " << conn.blockOffsets.size() << " blocks of " << conn.filename << " in its previous version and " << cached << " in the cache";
+   }
+   // ------------------------------------------------------------------------
+   awaitable<Client::Outcome> Client::receive_windows(FileTransfer& transfer, Connection& conn)
+   {
+      while (!conn.isFileTransferComplete()) {
+         if (cancelled) co_return Outcome::CANCELLED;
 
-      fileRequests.erase(filename);
+         conn.windowLimit = 0;
+         if (!conn.blockOffsets.empty()) {
+            if (!co_await offload([&] { return copy_blocks(conn); })) {
+               PLOG_WARNING << "[Client] Could not write to file " << conn.filename;
+               co_return Outcome::WRITE_FAILED;
+            }
+            if (conn.isFileTransferComplete()) break;
+         }
 
-      PLOG_INFO << "[Client] Got Initial response for file: " << filename;
+         request_transmission(conn);
+         publish(transfer, conn);
+         // after the first response to the Transmission Request the window is completed by Retransmission Requests
+         bool responded = false;
+         auto deadline = NOW + conn.rtt.rto();
+
+         while (!conn.window.isWindowComplete()) {
+            auto msg = co_await receive(transfer, deadline);
+            if (!msg) {
+               if (cancelled) co_return Outcome::CANCELLED;
+
+               if (conn.retryCounter > conn.maxRetries) {
+                  PLOG_ERROR << "[Client] Sent multiple " << (responded ? "Retransmission" : "Transmission") << " Requests. Server may have disconnected.";
+                  co_return Outcome::DISCONNECTED;
+               }
+
+               ++conn.retryCounter;
+               conn.rtt.backoff();
+               {
+                  std::lock_guard lock(statsMutex);
+                  ++stats.timeouts;
+               }
+               if (responded) {
+                  RFT_LOG_EVERY(plog::info, seconds(1)) << "[Client] Repeating Retransmission Request for " << conn.connectionId;
+                  if (trace::enabled()) trace::record(trace::Source::CLIENT, trace::EventType::TIMEOUT, conn.connectionId, trace::RETRANSMISSION_TIMEOUT);
+                  request_retransmission(conn);
+               } else {
+                  RFT_LOG_EVERY(plog::info, seconds(1)) << "[Client] Repeating Transmission Request for " << conn.connectionId;
+                  if (trace::enabled()) trace::record(trace::Source::CLIENT, trace::EventType::TIMEOUT, conn.connectionId, trace::TRANSMISSION_TIMEOUT);
+                  request_transmission(conn);
+               }
+               deadline = NOW + conn.rtt.rto();
+               continue;
+            }
 
-      auto connectionResumption = std::find_if(connections.begin(), connections.end(), [&](auto& conn) {
-         return std::filesystem::path(conn.second.filename).filename() == filename;
-      });
+            auto end = NOW;
+            bool stored = false;
+            switch (msg->header.type) {
+               case PAYLOAD:
+                  stored = store_payload(conn, *msg);
+                  break;
+               case COMPRESSED_PAYLOAD:
+                  stored = store_compressed(conn, *msg);
+                  break;
+               case PARITY_PAYLOAD:
+                  stored = store_parity(conn, *msg);
+                  break;
+               case ERROR_CONNECTION_NOT_FOUND: {
+                  auto error = wire::ConnectionNotFound::parse(wire::bytes(*msg));
+                  if (error && error->connectionId == conn.connectionId) {
+                     co_return Outcome::CONNECTION_NOT_FOUND;
+                  }
+                  break;
+               }
+               default:
+                  // late answers of the handshake
+                  break;
+            }
+            if (!stored) continue;
 
-      if (connectionResumption != connections.end()) {
-         // is connection resumption
-         auto& conn = connectionResumption->second;
-         if (std::strncmp(reinterpret_cast<char*>(conn.sha256), reinterpret_cast<char*>(sha256), SHA256_SIZE) != 0) {
-            // file changed
-            conn.file.close();
-            std::remove(conn.filename.c_str());
-            connections.erase(connectionResumption->first);
-         } else {
-            // file not changed -> need to update connectionId key
-            auto nh = connections.extract(connectionResumption->first);
-            nh.key() = connectionId;
-            connections.insert(std::move(nh));
-            // since unordered_map::insert only inserts e if e is not present in map, the second insert call below won't insert the connection a second time
+            track_window_response(conn, end);
+            responded = true;
+            deadline = NOW + conn.rtt.rto();
          }
-      }
 
-      std::string dest = fileDest + "/" + filename;
-      Window window{MAX_THROUGHPUT * 1024 * 1024 / CHUNK_SIZE};
+         const uint16_t currentWindowSize = conn.window.currentSize;
+         conn.chunksLost = currentWindowSize - conn.window.chunksTransmitted;
+         if (trace::enabled()) trace::record(trace::Source::CLIENT, trace::EventType::WINDOW_COMPLETED, conn.connectionId, currentWindowSize, conn.window.chunksTransmitted);
 
-      try {
-         connections.insert({connectionId, Connection{dest, fileSize, sha256, std::move(window), io_context}});
-      } catch (const std::system_error& ex) {
-         PLOG_ERROR << "[Client] Error when initializing Connection. ";
-         done = connections.empty() && fileRequests.empty();
-         send_finish_msg(connectionId);
-         return;
-      }
+         if (!co_await offload([&] { return write_window(conn); })) {
+            // No space left
+            PLOG_WARNING << "[Client] Could not write to file " << conn.filename;
+            co_return Outcome::WRITE_FAILED;
+         }
+         publish(transfer, conn);
+         report_progress(conn, false);
 
-      request_transmission(connectionId);
+         ++conn.window.id;
+      }
+      co_return Outcome::COMPLETE;
    }
    // ------------------------------------------------------------------------
-   void Client::handle_payload_packet(Message<ServerMsgType>& msg)
+   bool Client::verify(Connection& conn)
    {
-      auto end = NOW;
-
-      uint16_t chunkSize = msg.header.size - (PAYLOAD_META_DATA_SIZE);
-
-      ConnectionID connectionId;
-      uint8_t windowId;
-      uint16_t currentWindowSize;
-      uint16_t sequenceNumber;
-      std::vector<unsigned char> chunk(chunkSize);
+      return conn.file.sha256() == conn.sha256;
+   }
+   // ------------------------------------------------------------------------
+   void Client::discard(Connection& conn)
+   {
+      std::remove(conn.filename.c_str());
+      if (!conn.basis.empty()) {
+         std::rename(conn.basis.c_str(), conn.filename.c_str());
+      }
+   }
+   // ------------------------------------------------------------------------
+   bool Client::store_payload(Connection& conn, const Message<ServerMsgType>& msg)
+   {
+      // the chunk is copied from the received packet into the window's buffer for it
+      auto payload = wire::Payload::parse(wire::bytes(msg));
+      if (!payload) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Client] Dropping malformed payload packet";
+         return false;
+      }
+      // Ignore delayed packets
+      if (payload->connectionId != conn.connectionId || payload->windowId != conn.window.id) return false;
 
-      msg >> chunk;
-      msg >> sequenceNumber;
-      msg >> currentWindowSize;
-      msg >> windowId;
-      msg >> connectionId;
+      conn.window.currentSize = payload->windowSize;
+      conn.window.store_chunk(payload->data, payload->sequenceNumber);
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   bool Client::store_compressed(Connection& conn, const Message<ServerMsgType>& msg)
+   {
+      auto payload = wire::Payload::parse(wire::bytes(msg));
+      if (!payload) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Client] Dropping malformed compressed packet";
+         return false;
+      }
+      // Ignore delayed packets
+      if (payload->connectionId != conn.connectionId || payload->windowId != conn.window.id) return false;
+
+      const uint16_t currentWindowSize = payload->windowSize;
+      uint16_t sequenceNumber = payload->sequenceNumber;
+
+      // the packet holds consecutive chunks, but never more than are left in the window
+      unsigned char chunks[MAX_COMPRESSED_CHUNKS * CHUNK_SIZE];
+      size_t capacity = std::min<size_t>(MAX_COMPRESSED_CHUNKS, currentWindowSize - sequenceNumber) * CHUNK_SIZE;
+      auto size = lz::decompress(payload->data.data(), payload->data.size(), chunks, capacity);
+      if (!size) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Client] Dropping malformed compressed packet for connection ID " << conn.connectionId;
+         return false;
+      }
 
-      auto search = connections.find(connectionId);
-      if (search == connections.end()) {
-         // Ignore unknown connection id
-         return;
+      conn.window.currentSize = currentWindowSize;
+      for (size_t offset = 0; offset < *size; offset += CHUNK_SIZE, ++sequenceNumber) {
+         conn.window.store_chunk({chunks + offset, std::min<size_t>(*size - offset, CHUNK_SIZE)}, sequenceNumber);
+      }
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   bool Client::store_parity(Connection& conn, const Message<ServerMsgType>& msg)
+   {
+      auto parity = wire::ParityPayload::parse(wire::bytes(msg));
+      if (!parity) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Client] Dropping malformed parity packet";
+         return false;
       }
-      auto& conn = search->second;
+      // Ignore delayed packets
+      if (parity->connectionId != conn.connectionId || parity->windowId != conn.window.id) return false;
 
+      conn.window.currentSize = parity->windowSize;
+      conn.window.store_parity(parity->parity, parity->lengths, parity->group, parity->groups);
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   void Client::track_window_response(Connection& conn, timepoint end)
+   {
       if (conn.shouldMeasureTime) {
-         auto duration = chrono::duration_cast<timeunit>(end - conn.tp);
-         ++rttCount;
-         rttCurrent = duration.count();
-         rttTotal += rttCurrent;
+         // Karn's algorithm: only responses to requests that were not repeated after a timeout are sampled
+         if (conn.retryCounter == 1) {
+            conn.rtt.addSample(chrono::duration_cast<timeunit>(end - conn.tp));
+            if (trace::enabled()) {
+               trace::record(trace::Source::CLIENT, trace::EventType::RTT_SAMPLE, conn.connectionId, conn.rtt.smoothedRtt().count(), conn.rtt.rto().count());
+            }
+         }
          conn.shouldMeasureTime = false;
       }
 
-      if (windowId != conn.window.id) {
-         // Ignore delayed packets
-         return;
-      }
-
-      conn.timer.setTimeout(timeunit(rttTotal / rttCount * TIMEOUT), boost::bind(&Client::handle_retransmission_timeout, this, connectionId));
-
       // Server did respond -> reset retry counter
       conn.retryCounter = 1;
+   }
+   // ------------------------------------------------------------------------
+   bool Client::write_window(Connection& conn)
+   {
+      const uint16_t currentWindowSize = conn.window.currentSize;
 
-      conn.window.store_chunk(chunk, sequenceNumber);
-      conn.window.currentSize = currentWindowSize;
-
-      if (conn.window.isWindowComplete()) {
-         // TODO: maybe extract this to separate function
-         conn.timer.cancel();
-
-         uint32_t bytesWritten = 0;
-         for (size_t i = 0; i < currentWindowSize; ++i) {
-            uint32_t bytes = conn.window.chunks[i].size();
-            conn.file.write(reinterpret_cast<char*>(conn.window.chunks[i].data()), bytes);
+      uint64_t bytesWritten = 0;
+      for (size_t i = 0; i < currentWindowSize; ++i) {
+         uint32_t bytes = conn.window.chunks[i].size();
+         if (!conn.file.write(conn.window.chunks[i].data(), bytes)) return false;
 
-            // No space left
-            if (!conn.file) {
-               PLOG_WARNING << "[Client] Could not write to file " << conn.filename;
-               send_finish_msg(connectionId);
-               return;
-            }
+         bytesWritten += bytes;
+      }
+      conn.bytesWritten += bytesWritten;
+      conn.chunksWritten += currentWindowSize;
+      {
+         std::lock_guard lock(statsMutex);
+         stats.bytesReceived += bytesWritten;
+      }
 
-            bytesWritten += bytes;
+      RFT_LOG(plog::verbose) << "[Client] Written " << currentWindowSize << " chunk" << ((currentWindowSize > 1) ? "s" : "")
+                             << "(" << bytesWritten << "B)"
+                             << " to disk";
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   bool Client::copy_blocks(Connection& conn)
+   {
+      const uint32_t blockSize = conn.manifest.blockSize;
+      const uint32_t blockChunks = blockSize / CHUNK_SIZE;
+      std::ifstream basis(conn.basis, std::ios::in | std::ios::binary);
+      std::vector<char> buffer(blockSize);
+
+      // windows end in front of the blocks that are present, hence they are always reached at their first chunk
+      uint64_t block = conn.chunksWritten / blockChunks;
+      while (block < conn.blockOffsets.size() && conn.blockOffsets[block] != -1) {
+         const uint64_t size = std::min<uint64_t>(blockSize, conn.fileSize - block * blockSize);
+         bool loaded;
+         if (conn.blockOffsets[block] == Connection::BLOCK_CACHED) {
+            std::lock_guard lock(cacheMutex);
+            loaded = cache->load(conn.manifest.blocks[block], buffer.data(), size);
+         } else {
+            basis.seekg(conn.blockOffsets[block]);
+            basis.read(buffer.data(), static_cast<std::streamsize>(size));
+            loaded = static_cast<bool>(basis);
          }
-         conn.bytesWritten += bytesWritten;
-         conn.chunksWritten += currentWindowSize;
-         conn.file.flush();
-
-         PLOG_VERBOSE << "[Client] Written " << currentWindowSize << " chunk" << ((currentWindowSize > 1) ? "s" : "")
-                      << "(" << bytesWritten << "B)"
-                      << " to disk";
-
-         if (conn.isFileTransferComplete()) {
-            unsigned char sha256[SHA256_SIZE];
-            compute_file_SHA256(conn.filename, sha256);
-            if (std::strncmp(reinterpret_cast<char*>(conn.sha256), reinterpret_cast<char*>(sha256), SHA256_SIZE) != 0) {
-               PLOG_ERROR << "[Client] File " << conn.filename << " was not transferred successfully (wrong SHA256 checksum)\nPlease request file again!";
-               connections.erase(connectionId);
-               done = connections.empty() && fileRequests.empty();
-               return;
-            }
-
-            PLOG_INFO << "[Client] Transferred file " << conn.filename << " successfully";
-            connections.erase(connectionId);
-            done = connections.empty() && fileRequests.empty();
-            send_finish_msg(connectionId);
-            return;
+         if (!loaded) {
+            // the local copy changed in the meantime, the block is transferred instead
+            conn.blockOffsets[block] = -1;
+            break;
          }
 
-         ++conn.window.id;
-         request_transmission(connectionId);
+         if (!conn.file.write(buffer.data(), size)) return false;
+
+         conn.bytesWritten += size;
+         conn.bytesCopied += size;
+         conn.chunksWritten += (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+         ++block;
       }
+
+      uint64_t next = block + 1;
+      while (next < conn.blockOffsets.size() && conn.blockOffsets[next] == -1) {
+         ++next;
+      }
+      if (next < conn.blockOffsets.size()) {
+         conn.windowLimit = next * blockChunks - conn.chunksWritten;
+      }
+      return true;
    }
    // ------------------------------------------------------------------------
-   void Client::request_transmission(ConnectionID connectionId)
+   void Client::request_transmission(Connection& conn)
    {
-      auto& conn = connections.at(connectionId);
-      conn.timer.setTimeout(timeunit(rttTotal / rttCount * TIMEOUT), boost::bind(&Client::handle_transmission_timeout, this, connectionId));
-
       Message<ClientMsgType> msgOut;
-      msgOut.header.type = TRANSMISSION_REQUEST;
-      msgOut.header.size = 0;
-      msgOut.header.remote = socket.local_endpoint();
 
-      msgOut << TRANSMISSION_REQUEST;
-      msgOut << connectionId;
-      msgOut << conn.window.id;
-      msgOut << rttCurrent;
-      msgOut << conn.chunksWritten;
+      {
+         std::lock_guard lock(statsMutex);
+         ++stats.transmissionRequests;
+      }
+
+      wire::TransmissionRequest::encode(msgOut, conn.connectionId, conn.window.id, conn.rtt.smoothedRtt().count(), conn.chunksWritten, conn.chunksLost, conn.windowLimit);
 
       conn.window.reset();
 
-      PLOG_VERBOSE << "[Client] Requesting chunks at index: " << conn.chunksWritten << " for file " << conn.filename;
+      RFT_LOG(plog::verbose) << "[Client] Requesting chunks at index: " << conn.chunksWritten << " for file " << conn.filename;
 
       conn.shouldMeasureTime = true;
       conn.tp = NOW;
@@ -454,25 +947,27 @@ namespace rft
       send_msg(msgOut);
    }
    // ------------------------------------------------------------------------
-   void Client::request_retransmission(ConnectionID connectionId)
+   void Client::request_retransmission(Connection& conn)
    {
-      auto& conn = connections.at(connectionId);
-      conn.timer.setTimeout(timeunit(rttTotal / rttCount * TIMEOUT), boost::bind(&Client::handle_retransmission_timeout, this, connectionId));
-
       Message<ClientMsgType> msgOut;
-      msgOut.header.type = RETRANSMISSION_REQUEST;
-      msgOut.header.size = 0;
-      msgOut.header.remote = socket.local_endpoint();
 
-      Bitfield bitfield(conn.window.currentSize);
-      bitfield.from(conn.window.sequenceNumbers);
+      {
+         std::lock_guard lock(statsMutex);
+         ++stats.retransmissionRequests;
+      }
 
-      msgOut << RETRANSMISSION_REQUEST;
-      msgOut << connectionId;
-      msgOut << conn.window.id;
-      msgOut << bitfield.bitfield;
+      wire::RetransmissionRequest::encode(msgOut, conn.connectionId, conn.window.id);
 
-      PLOG_INFO << "[Client] Requesting retransmission for connection ID " << connectionId;
+      // write the bitfield of the current window directly into the packet
+      conn.window.sequenceNumbers.to(&msgOut.packet[msgOut.header.size], conn.window.currentSize);
+      msgOut.header.size += Bitfield::byte_size(conn.window.currentSize);
+
+      conn.window.retransmitting = true;
+      if (trace::enabled()) {
+         trace::record(trace::Source::CLIENT, trace::EventType::RETRANSMISSION, conn.connectionId, conn.window.currentSize - conn.window.chunksReceived);
+      }
+
+      RFT_LOG(plog::debug) << "[Client] Requesting retransmission for connection ID " << conn.connectionId;
 
       conn.shouldMeasureTime = true;
       conn.tp = NOW;
@@ -483,181 +978,111 @@ namespace rft
    void Client::send_finish_msg(ConnectionID connectionId)
    {
       Message<ClientMsgType> msgOut;
-      msgOut.header.type = CLIENT_FINISH_MESSAGE;
-      msgOut.header.size = 0;
-      msgOut.header.remote = socket.local_endpoint();
-
-      msgOut << CLIENT_FINISH_MESSAGE;
-      msgOut << connectionId;
+      wire::FinishMessage::encode(msgOut, CLIENT_FINISH_MESSAGE, connectionId);
 
       send_msg(msgOut);
    }
    // ------------------------------------------------------------------------
-   void Client::handle_file_request_timeout(std::string& filename)
+   void Client::report_progress(const Connection& conn, bool complete)
    {
-      auto search = fileRequests.find(filename);
-      if (search != fileRequests.end()) {
-         auto& fr = search->second;
+      // the manifest is part of the transfer of its file
+      if (!progressHandler || conn.isManifest) return;
 
-         if (fr.retryCounter >= fr.maxRetries) {
-            PLOG_ERROR << "[Client] Requested file " << filename << " multiple times without success.";
-            fileRequests.erase(filename);
-            done = fileRequests.empty() && connections.empty();
-            // wake the main thread that is waiting on the msqQueue condition variable
-            msgQueue.wake();
-            return;
-         }
-
-         if (fr.timer.isExpired()) {
-            PLOG_INFO << "[Client] Repeating request for file: " << filename;
-            ++fr.retryCounter;
-            request_file(filename);
-         }
-      }
+      progressHandler(Progress{conn.filename, conn.bytesWritten, conn.fileSize, complete});
    }
    // ------------------------------------------------------------------------
-   void Client::handle_validation_response_timeout(std::string& filename)
+   void Client::publish(FileTransfer& transfer, const Connection& conn)
    {
-      auto search = fileRequests.find(filename);
-      if (search != fileRequests.end()) {
-         auto& fr = search->second;
-
-         if (fr.retryCounter >= fr.maxRetries) {
-            PLOG_ERROR << "[Client] Sent validation response for " << filename << " multiple times without success.";
-            fileRequests.erase(filename);
-            done = fileRequests.empty() && connections.empty();
-            // wake the main thread that is waiting on the msqQueue condition variable
-            msgQueue.wake();
-            return;
-         }
-
-         if (fr.timer.isExpired()) {
-            PLOG_INFO << "[Client] Repeating validation response for file : " << filename;
-            ++fr.retryCounter;
-
-            Message<ClientMsgType> msgOut;
-            msgOut.header.type = CLIENT_VALIDATION_RESPONSE;
-            msgOut.header.size = 0;
-            msgOut.header.remote = socket.local_endpoint();
-
-            msgOut << CLIENT_VALIDATION_RESPONSE;
-            msgOut << fr.hash1Solution;
-            msgOut << fr.nonce;
-            msgOut << MAX_THROUGHPUT;
-            msgOut << filename;
-
-            // Set a reasonably long timeout to validate the solution
-            fr.timer.setTimeout(minutes(1), boost::bind(&Client::handle_validation_response_timeout, this, filename));
-            send_msg(msgOut);
-         }
-      }
-   }
-   // ------------------------------------------------------------------------
-   void Client::handle_validation_failed(Message<ServerMsgType>& msg)
-   {
-      size_t filenameSize = msg.header.size - CLIENT_VALIDATION_FAILED_META_DATA;
-      std::string filename(filenameSize, '\0');
-
-      msg >> filename;
-
-      fileRequests.erase(filename);
-      done = connections.empty() && fileRequests.empty();
-
-      PLOG_WARNING << "[Client] Validation failed for file " << filename << "\nYou might want to retry the file transfer!";
+      transfer.windowSize = conn.window.currentSize;
+      transfer.srtt = conn.rtt.smoothedRtt().count();
+      transfer.rto = conn.rtt.rto().count();
+      transfer.chunksLost = conn.chunksLost;
+      transfer.fileSize = conn.fileSize;
+      transfer.bytesWritten = conn.bytesWritten;
    }
    // ------------------------------------------------------------------------
-   void Client::handle_file_not_found(Message<ServerMsgType>& msg)
+   void Client::register_connection(FileTransfer& transfer, ConnectionID connectionId)
    {
-      size_t filenameSize = msg.header.size - FILE_NOT_FOUND_META_DATA;
-      std::string filename(filenameSize, '\0');
-
-      msg >> filename;
-
-      fileRequests.erase(filename);
-      done = connections.empty() && fileRequests.empty();
-
-      PLOG_WARNING << "[Client] File " << filename << " not found on server!";
+      std::lock_guard lock(transfersMutex);
+      connections[connectionId] = transfers.at(transfer.name);
+      transfer.connectionId = connectionId;
+      transfer.connected = true;
    }
    // ------------------------------------------------------------------------
-   void Client::handle_connection_not_found(Message<ServerMsgType>& msg)
+   void Client::unregister_connection(FileTransfer& transfer, ConnectionID connectionId)
    {
-      ConnectionID connectionId;
-
-      msg >> connectionId;
-
+      std::lock_guard lock(transfersMutex);
       auto search = connections.find(connectionId);
-      if (search != connections.end()) {
-         auto& conn = search->second;
-         request_file(std::filesystem::path(conn.filename).filename());
+      if (search != connections.end() && search->second.get() == &transfer) {
+         connections.erase(search);
       }
+      transfer.connected = false;
    }
    // ------------------------------------------------------------------------
-   void Client::handle_transmission_timeout(ConnectionID connectionId)
+   awaitable<void> Client::export_metrics_periodically()
    {
-      auto search = connections.find(connectionId);
-      if (search != connections.end()) {
-         auto& conn = search->second;
-
-         if (conn.retryCounter > conn.maxRetries) {
-            PLOG_ERROR << "[Client] Sent multiple Transmission Requests. Server may have disconnected.";
-            std::remove(conn.filename.c_str());
-            connections.erase(connectionId);
-            done = fileRequests.empty() && connections.empty();
-            // wake the main thread that is waiting on the msqQueue condition variable
-            msgQueue.wake();
-            return;
-         }
-
-         if (conn.timer.isExpired()) {
-            PLOG_INFO << "[Client] Repeating Transmission Request for " << connectionId;
-            ++conn.retryCounter;
-            request_transmission(connectionId);
+      while (!metricsStopped) {
+         boost::system::error_code error;
+         metricsTimer.expires_after(METRICS_INTERVAL);
+         co_await metricsTimer.async_wait(redirect_error(use_awaitable, error));
+         if (!metricsStopped) {
+            export_metrics();
          }
       }
    }
    // ------------------------------------------------------------------------
-   void Client::handle_retransmission_timeout(ConnectionID connectionId)
+   void Client::export_metrics()
    {
-      auto search = connections.find(connectionId);
-      if (search != connections.end()) {
-         auto& conn = search->second;
-
-         if (conn.retryCounter > conn.maxRetries) {
-            PLOG_ERROR << "[Client] Sent multiple Retransmission Requests. Server may have disconnected.";
-            std::remove(conn.filename.c_str());
-            connections.erase(connectionId);
-            done = fileRequests.empty() && connections.empty();
-            // wake the main thread that is waiting on the msqQueue condition variable
-            msgQueue.wake();
-            return;
-         }
+      Exposition page("role=\"client\"");
 
-         if (conn.timer.isExpired()) {
-            PLOG_INFO << "[Client] Retransmission Request for " << connectionId;
-            ++conn.retryCounter;
-            request_retransmission(connectionId);
+      Statistics counters;
+      {
+         std::lock_guard lock(statsMutex);
+         counters = stats;
+      }
+      page.counter("rft_packets_sent_total", "Packets sent, including those the emulated link drops", packetsSent);
+      page.counter("rft_bytes_sent_total", "Bytes of the packets sent", bytesSent);
+      page.counter("rft_packets_received_total", "Packets received", packetsReceived);
+      page.counter("rft_bytes_received_total", "Bytes of the packets received", bytesReceived);
+      page.counter("rft_files_transferred_total", "Files transferred and verified", counters.filesTransferred);
+      page.counter("rft_file_bytes_received_total", "Bytes of file contents that arrived over the network", counters.bytesReceived);
+      page.counter("rft_file_bytes_copied_total", "Bytes of file contents copied from local copies", counters.bytesCopied);
+      page.counter("rft_transmission_requests_total", "Transmission Requests sent", counters.transmissionRequests);
+      page.counter("rft_retransmission_requests_total", "Retransmission Requests sent", counters.retransmissionRequests);
+      page.counter("rft_timeouts_total", "Expired timeouts of file requests and connections", counters.timeouts);
+
+      std::vector<std::shared_ptr<FileTransfer>> connected;
+      size_t requests = 0;
+      {
+         std::lock_guard lock(transfersMutex);
+         for (auto& [name, transfer]: transfers) {
+            if (transfer->connected) {
+               connected.push_back(transfer);
+            } else {
+               ++requests;
+            }
          }
       }
-   }
-   // ------------------------------------------------------------------------
-   void Client::handle_user_termination()
-   {
-      signal(SIGINT, [](int signum) {
-         PLOG_WARNING << "[Client] Aborted file transfer. Deleting all incomplete files!";
-         Client::abort = 1;
-      });
-   }
-   // ------------------------------------------------------------------------
-   void Client::delete_incomplete_files()
-   {
-      for (auto& conn: connections) {
-         PLOG_WARNING << "[Client] Deleting incomplete file " << conn.second.filename;
-         conn.second.file.close();
-         std::remove(conn.second.filename.c_str());
-
-         // Specification says that a Client Connection Termination message should be sent.
-         // In hindsight, there is no need for that message as the Client Finish Message can be used instead (the server does not need to know why the client terminated/finished)
-         send_finish_msg(conn.first);
+      page.gauge("rft_connections", "Open connections", static_cast<double>(connected.size()));
+      page.gauge("rft_file_requests", "File requests waiting for the Server Initial Response", static_cast<double>(requests));
+      page.gauge("rft_message_queue_depth", "Received messages waiting to be processed", static_cast<double>(queued));
+      page.histogram("rft_handshake_seconds", "Time from the first File Request until the Server Initial Response", handshakeLatency);
+
+      auto perConnection = [&](const std::string& name, const std::string& help, auto value) {
+         page.family(name, "gauge", help);
+         for (auto& transfer: connected) {
+            page.sample(name, "connection=\"" + std::to_string(transfer->connectionId.load()) + "\",file=\"" + Exposition::escape(transfer->dest) + "\"", static_cast<double>(value(*transfer)));
+         }
+      };
+      perConnection("rft_connection_window_chunks", "Size of the current window in chunks", [](const FileTransfer& transfer) { return transfer.windowSize.load(); });
+      perConnection("rft_connection_srtt_microseconds", "Smoothed RTT", [](const FileTransfer& transfer) { return transfer.srtt.load(); });
+      perConnection("rft_connection_rto_microseconds", "Retransmission timeout", [](const FileTransfer& transfer) { return transfer.rto.load(); });
+      perConnection("rft_connection_chunks_lost", "Chunks of the last window that did not arrive with its first transmission", [](const FileTransfer& transfer) { return transfer.chunksLost.load(); });
+      perConnection("rft_connection_file_bytes", "Size of the transferred file", [](const FileTransfer& transfer) { return transfer.fileSize.load(); });
+      perConnection("rft_connection_bytes_written", "Bytes of the file that are written", [](const FileTransfer& transfer) { return transfer.bytesWritten.load(); });
+
+      if (!Exposition::write(metricsFile, page.str())) {
+         PLOG_WARNING << "[Client] Could not write metrics to " << metricsFile;
       }
    }
    // ------------------------------------------------------------------------
@@ -0,0 +1,145 @@
+// ------------------------------------------------------------------------
+#include "Compression.hpp"
+#include <array>
+#include <cmath>
+#include <cstring>
+// ------------------------------------------------------------------------
+namespace rft::lz
+{
+   namespace
+   {
+      const size_t MIN_MATCH = 4;
+      const size_t MAX_MATCH = 0x7F + MIN_MATCH;
+      const size_t MAX_LITERALS = 0x80;
+      const size_t MAX_DISTANCE = 0xFFFF;
+      const uint8_t HASH_BITS = 12;
+
+      uint32_t read32(const unsigned char* p)
+      {
+         uint32_t v;
+         std::memcpy(&v, p, sizeof(v));
+         return v;
+      }
+
+      uint32_t hash(uint32_t v)
+      {
+         return (v * 2654435761U) >> (32 - HASH_BITS);
+      }
+
+      bool emit_literals(const unsigned char* in, size_t count, unsigned char* out, size_t capacity, size_t& o)
+      {
+         while (count > 0) {
+            size_t n = std::min(count, MAX_LITERALS);
+            if (o + 1 + n > capacity) return false;
+            out[o++] = n - 1;
+            std::memcpy(&out[o], in, n);
+            o += n;
+            in += n;
+            count -= n;
+         }
+         return true;
+      }
+
+      /// Encodes in[start, end), matches may refer to the preceding chunks but do not cross end
+      bool compress_chunk(const unsigned char* in, size_t start, size_t end, std::array<uint32_t, 1 << HASH_BITS>& table,
+                          unsigned char* out, size_t capacity, size_t& o)
+      {
+         size_t pos = start;
+         size_t literals = start;
+         while (pos + MIN_MATCH <= end) {
+            uint32_t h = hash(read32(&in[pos]));
+            // positions are stored + 1, 0 marks an empty entry
+            size_t candidate = table[h];
+            table[h] = pos + 1;
+
+            if (candidate == 0 || pos - (candidate - 1) > MAX_DISTANCE || read32(&in[candidate - 1]) != read32(&in[pos])) {
+               ++pos;
+               continue;
+            }
+
+            size_t match = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (pos + length < end && length < MAX_MATCH && in[match + length] == in[pos + length]) {
+               ++length;
+            }
+
+            if (!emit_literals(&in[literals], pos - literals, out, capacity, o)) return false;
+            if (o + 3 > capacity) return false;
+            size_t distance = pos - match;
+            out[o++] = 0x80 | (length - MIN_MATCH);
+            out[o++] = distance >> 8;
+            out[o++] = distance & 0xFF;
+
+            pos += length;
+            literals = pos;
+         }
+         return emit_literals(&in[literals], end - literals, out, capacity, o);
+      }
+   }// namespace
+   // ------------------------------------------------------------------------
+   bool is_compressible(const unsigned char* data, size_t size)
+   {
+      if (size < MIN_MATCH) return false;
+
+      std::array<uint32_t, 256> counts{};
+      for (size_t i = 0; i < size; ++i) {
+         ++counts[data[i]];
+      }
+
+      double entropy = 0;
+      for (uint32_t count: counts) {
+         if (count == 0) continue;
+         double p = static_cast<double>(count) / size;
+         entropy -= p * std::log2(p);
+      }
+      return entropy <= MAX_ENTROPY;
+   }
+   // ------------------------------------------------------------------------
+   size_t compress_chunks(const unsigned char* in, size_t size, unsigned char* out, size_t capacity, size_t& outSize)
+   {
+      std::array<uint32_t, 1 << HASH_BITS> table{};
+      size_t o = 0;
+      size_t consumed = 0;
+      while (consumed < size) {
+         size_t end = std::min(size, consumed + CHUNK_SIZE);
+         size_t mark = o;
+         if (!compress_chunk(in, consumed, end, table, out, capacity, o)) {
+            // the output of the chunk that did not fit is dropped, the stream ends at the previous chunk
+            o = mark;
+            break;
+         }
+         consumed = end;
+      }
+      outSize = o;
+      return consumed;
+   }
+   // ------------------------------------------------------------------------
+   std::optional<size_t> decompress(const unsigned char* in, size_t size, unsigned char* out, size_t capacity)
+   {
+      size_t i = 0;
+      size_t o = 0;
+      while (i < size) {
+         uint8_t c = in[i++];
+         if (c < 0x80) {
+            size_t n = c + 1;
+            if (i + n > size || o + n > capacity) return std::nullopt;
+            std::memcpy(&out[o], &in[i], n);
+            i += n;
+            o += n;
+         } else {
+            size_t length = (c & 0x7F) + MIN_MATCH;
+            if (i + 2 > size) return std::nullopt;
+            size_t distance = (static_cast<size_t>(in[i]) << 8) | in[i + 1];
+            i += 2;
+            if (distance == 0 || distance > o || o + length > capacity) return std::nullopt;
+            // byte by byte, the match may overlap the bytes it produces
+            for (size_t k = 0; k < length; ++k, ++o) {
+               out[o] = out[o - distance];
+            }
+         }
+      }
+      return o;
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft::lz
+// ------------------------------------------------------------------------
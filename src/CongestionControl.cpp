@@ -7,7 +7,8 @@ namespace rft
    // ------------------------------------------------------------------------
    uint16_t CongestionControl::getNextWindowSize(uint32_t rrt)
    {
-      rttCurrent = rrt;
+      // the client reports 0 before it took its first sample
+      rttCurrent = std::max(rrt, 1U);
       rttMax = std::max(rttMax, rttCurrent);
 
       uint16_t maxMBps = chrono::duration_cast<seconds>(timeunit(rttCurrent).count() * chrono::duration_cast<timeunit>(seconds(maxThroughput))).count();
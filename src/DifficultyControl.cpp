@@ -0,0 +1,84 @@
+// ------------------------------------------------------------------------
+#include "DifficultyControl.hpp"
+#include <cmath>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   /// Number of additional bits needed to make solving value/normal times harder (each bit doubles the work)
+   static uint8_t excess_bits(double value, double normal)
+   {
+      if (value <= normal) return 0;
+      return static_cast<uint8_t>(std::ceil(std::log2(value / normal)));
+   }
+   // ------------------------------------------------------------------------
+   uint8_t DifficultyControl::getDifficulty(const ip::address& source, size_t queueDepth, size_t pendingValidations)
+   {
+      ++handshakes;
+      if (NOW - intervalStart >= INTERVAL) {
+         measure_load();
+      }
+
+      // A flood is visible before the interval ends: the requests seen so far are a lower bound for the current rate
+      double rate = std::max(handshakeRate, handshakes / chrono::duration<double>(INTERVAL).count());
+
+      uint32_t bits = MIN_DIFFICULTY;
+      bits += excess_bits(rate, NORMAL_HANDSHAKE_RATE);
+      bits += std::max(excess_bits(static_cast<double>(queueDepth), NORMAL_QUEUE_DEPTH),
+                       excess_bits(static_cast<double>(pendingValidations), NORMAL_PENDING_VALIDATIONS));
+      if (cpuUsage > CPU_THRESHOLD) {
+         bits += static_cast<uint32_t>(std::ceil((std::min(cpuUsage, 1.0) - CPU_THRESHOLD) / (1 - CPU_THRESHOLD) * MAX_CPU_BITS));
+      }
+      bits = std::min<uint32_t>(bits, MAX_DIFFICULTY);
+
+      if (bits != difficulty) {
+         PLOG_INFO << "[Server] Client validation difficulty changed from " << +difficulty << " to " << bits << " bits";
+         difficulty = bits;
+      }
+
+      if (useReputation) {
+         bits += reputation_bits(source);
+      }
+
+      return std::min<uint32_t>(bits, MAX_DIFFICULTY);
+   }
+   // ------------------------------------------------------------------------
+   void DifficultyControl::measure_load()
+   {
+      auto now = NOW;
+      double elapsed = chrono::duration<double>(now - intervalStart).count();
+      double cpuTime = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+
+      handshakeRate = handshakes / elapsed;
+      cpuUsage = cpuTime / elapsed / SERVER_THREADS;
+
+      intervalStart = now;
+      cpuStart = std::clock();
+      handshakes = 0;
+
+      // Sources that stopped sending requests slowly regain their reputation
+      for (auto it = sources.begin(); it != sources.end();) {
+         it->second /= 2;
+         if (it->second < 1) {
+            it = sources.erase(it);
+         } else {
+            ++it;
+         }
+      }
+   }
+   // ------------------------------------------------------------------------
+   uint8_t DifficultyControl::reputation_bits(const ip::address& source)
+   {
+      auto search = sources.find(source);
+      if (search == sources.end()) {
+         // Under a spoofed flood the global load already raises the difficulty, do not track further sources
+         if (sources.size() >= MAX_SOURCES) return 0;
+         search = sources.emplace(source, 0).first;
+      }
+
+      search->second += 1;
+      return excess_bits(search->second, NORMAL_SOURCE_REQUESTS);
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
@@ -0,0 +1,107 @@
+// ------------------------------------------------------------------------
+#include "FileCache.hpp"
+#include "Manifest.hpp"
+#include "util.hpp"
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   FileCache::File::~File()
+   {
+      close(fd);
+   }
+   // ------------------------------------------------------------------------
+   std::shared_ptr<const FileCache::File> FileCache::File::open(const std::string& path)
+   {
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) return nullptr;
+
+      auto id = ReadCache::identify(fd);
+      if (!id) {
+         close(fd);
+         return nullptr;
+      }
+      return std::make_shared<const File>(fd, *id);
+   }
+   // ------------------------------------------------------------------------
+   size_t FileCache::File::read(uint64_t offset, unsigned char* buffer, size_t size) const
+   {
+      return read_at(fd, offset, buffer, size);
+   }
+   // ------------------------------------------------------------------------
+   const wire::Hash& FileCache::File::sha256() const
+   {
+      std::call_once(hashOnce, [this]() { compute_file_SHA256(fd, hash.data()); });
+      return hash;
+   }
+   // ------------------------------------------------------------------------
+   const std::shared_ptr<const FileCache::File>& FileCache::File::manifest() const
+   {
+      std::call_once(manifestOnce, [this]() {
+         // computed from the descriptor, it describes the same version as sha256(). The descriptor keeps it alive after it was unlinked.
+         std::string tmp = (std::filesystem::temp_directory_path() / "rft-manifest-XXXXXX").string();
+         int tmpFd = mkstemp(tmp.data());
+         if (tmpFd < 0) return;
+         close(tmpFd);
+         if (Manifest::compute(fd, id.size).write(tmp)) {
+            manifestFile = File::open(tmp);
+         }
+         std::filesystem::remove(tmp);
+      });
+      return manifestFile;
+   }
+   // ------------------------------------------------------------------------
+   std::shared_ptr<const FileCache::File> FileCache::open(const std::string& path)
+   {
+      // a cached file is revalidated with a stat of its path instead of being opened again. A file replaced right after the stat is
+      // still served in the version that was valid a moment earlier, opened files are identified by their descriptor.
+      auto id = ReadCache::identify(path);
+      if (!id) return nullptr;
+      {
+         std::unique_lock lock(mux);
+         auto search = files.find(path);
+         if (search != files.end() && search->second->second->id == *id) {
+            lru.splice(lru.begin(), lru, search->second);
+            return search->second->second;
+         }
+      }
+
+      // not cached, modified or replaced. The file is opened without holding the lock, other files are served in the meantime.
+      auto file = File::open(path);
+      if (file == nullptr) return nullptr;
+
+      std::unique_lock lock(mux);
+      auto search = files.find(path);
+      if (search != files.end()) {
+         if (search->second->second->id == file->id) {
+            // cached by a concurrent call in the meantime, the descriptor opened here is closed again
+            lru.splice(lru.begin(), lru, search->second);
+            return search->second->second;
+         }
+         // modified or replaced, connections holding the old version keep it open
+         lru.erase(search->second);
+         files.erase(search);
+      }
+
+      lru.emplace_front(path, file);
+      files.emplace(path, lru.begin());
+
+      while (lru.size() > capacity) {
+         files.erase(lru.back().first);
+         lru.pop_back();
+      }
+
+      return file;
+   }
+   // ------------------------------------------------------------------------
+   size_t FileCache::size() const
+   {
+      std::unique_lock lock(mux);
+      return lru.size();
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
@@ -0,0 +1,107 @@
+// ------------------------------------------------------------------------
+#include "FileWriter.hpp"
+#include "sha256.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   FileWriter::FileWriter(const std::string& filename, uint64_t size, bool direct)
+       : direct(direct), buffer(nullptr, std::free), capacity(std::clamp<uint64_t>((size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT, ALIGNMENT, BUFFER_SIZE)),
+         hash(std::make_unique<SHA256>())
+   {
+      const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+      if (direct) {
+         fd = open(filename.c_str(), flags | O_DIRECT, 0644);
+      }
+      if (fd < 0) {
+         // e.g., tmpfs does not support O_DIRECT
+         this->direct = false;
+         fd = open(filename.c_str(), flags, 0644);
+      }
+      if (fd < 0) return;
+
+      // file systems that cannot allocate ahead, e.g., ext3, write the file as before
+      if (size > 0 && fallocate(fd, 0, 0, static_cast<off_t>(size)) != 0 && errno != EOPNOTSUPP) {
+         failed = true;
+         return;
+      }
+
+      buffer.reset(static_cast<unsigned char*>(std::aligned_alloc(ALIGNMENT, capacity)));
+      failed = buffer == nullptr;
+   }
+   // ------------------------------------------------------------------------
+   FileWriter::~FileWriter()
+   {
+      if (fd >= 0) ::close(fd);
+   }
+   // ------------------------------------------------------------------------
+   bool FileWriter::write(const void* data, size_t size)
+   {
+      if (!*this) return false;
+
+      hash->add(data, size);
+      auto bytes = static_cast<const unsigned char*>(data);
+      while (size > 0) {
+         const size_t count = std::min(size, capacity - used);
+         std::memcpy(buffer.get() + used, bytes, count);
+         used += count;
+         bytes += count;
+         size -= count;
+
+         if (used == capacity && !flush()) return false;
+      }
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   bool FileWriter::flush()
+   {
+      // O_DIRECT needs a multiple of the alignment, only the tail of the file is shorter and written through the page cache
+      if (direct && used % ALIGNMENT != 0) {
+         direct = false;
+         if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT) != 0) {
+            failed = true;
+            return false;
+         }
+      }
+
+      size_t written = 0;
+      while (written < used) {
+         ssize_t n = pwrite(fd, buffer.get() + written, used - written, static_cast<off_t>(offset + written));
+         if (n < 0 && errno == EINTR) continue;
+         if (n <= 0) {
+            failed = true;
+            return false;
+         }
+         written += n;
+      }
+      offset += used;
+      used = 0;
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   bool FileWriter::close(bool sync)
+   {
+      if (!*this) return false;
+
+      // a file that was given up on is shorter than it was allocated, e.g., to serve as the basis of its next version
+      bool ok = flush() && ftruncate(fd, static_cast<off_t>(offset)) == 0 && (!sync || fdatasync(fd) == 0);
+      ok = ::close(fd) == 0 && ok;
+      fd = -1;
+      return ok;
+   }
+   // ------------------------------------------------------------------------
+   wire::Hash FileWriter::sha256()
+   {
+      wire::Hash result;
+      hash->getHash(result.data());
+      return result;
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
@@ -0,0 +1,147 @@
+// ------------------------------------------------------------------------
+#include "Link.hpp"
+#include <cstring>
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   Link::Link(ip::udp::socket& socket, const LinkConfig& config)
+       : socket(socket), config(config), engine(config.seed ? *config.seed : std::random_device{}()) {}
+   // ------------------------------------------------------------------------
+   double Link::draw()
+   {
+      return std::uniform_real_distribution<double>(0, 1)(engine);
+   }
+   // ------------------------------------------------------------------------
+   bool Link::lost()
+   {
+      switch (lossState) {
+         case PacketLossState::LOST:
+            if (draw() < config.q) {
+               return true;
+            }
+            lossState = PacketLossState::NOT_LOST;
+            return false;
+         case PacketLossState::NOT_LOST:
+            if (draw() < config.p) {
+               lossState = PacketLossState::LOST;
+               return true;
+            }
+            return false;
+      }
+      return false;
+   }
+   // ------------------------------------------------------------------------
+   Link::Schedule Link::schedule(size_t size)
+   {
+      std::unique_lock lock(mux);
+
+      if (lost()) return {};
+      if (!config.delays()) return {1};
+
+      auto now = NOW;
+      micros departure{0};
+      if (config.bandwidth > 0) {
+         while (!queue.empty() && queue.front() <= now) queue.pop_front();
+         if (config.queueLimit > 0 && queue.size() >= config.queueLimit) return {};
+
+         // the packet leaves once the ones before it and itself were put on the wire
+         idle = std::max(idle, now) + chrono::duration_cast<timepoint::duration>(micros(size * 1'000'000 / config.bandwidth));
+         queue.push_back(idle);
+         departure = chrono::duration_cast<micros>(idle - now);
+      }
+
+      Schedule fate{static_cast<uint8_t>(draw() < config.duplicate ? 2 : 1)};
+      for (uint8_t i = 0; i < fate.copies; ++i) {
+         fate.delay[i] = departure + config.delay + micros(static_cast<int64_t>(draw() * config.jitter.count()));
+         // held back by another one-way delay, at least a millisecond, so that the following packets overtake it
+         if (draw() < config.reorder) fate.delay[i] += std::max(config.delay + config.jitter, micros(1000));
+      }
+      return fate;
+   }
+   // ------------------------------------------------------------------------
+   bool Link::enable_zerocopy()
+   {
+      int one = 1;
+      if (setsockopt(socket.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0) return false;
+
+      zeroCopy = true;
+      await_completions();
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   bool Link::send_zerocopy(std::span<const unsigned char> header, std::span<const unsigned char> payload, std::shared_ptr<const void> owner,
+                            const ip::udp::endpoint& to)
+   {
+      InFlight packet{std::move(owner), {}};
+      if (header.size() > packet.header.size()) return false;
+      std::memcpy(packet.header.data(), header.data(), header.size());
+
+      iovec iov[2] = {{packet.header.data(), header.size()}, {const_cast<unsigned char*>(payload.data()), payload.size()}};
+      msghdr msg{};
+      msg.msg_name = const_cast<sockaddr*>(to.data());
+      msg.msg_namelen = to.size();
+      msg.msg_iov = iov;
+      msg.msg_iovlen = 2;
+
+      std::unique_lock lock(zeroCopyMux);
+      // a full send buffer or pinned memory exceeding optmem_max, the packet is copied instead
+      if (sendmsg(socket.native_handle(), &msg, MSG_ZEROCOPY | MSG_DONTWAIT) < 0) {
+         ++zeroCopyRefused;
+         return false;
+      }
+      inFlight.emplace(nextSend++, std::move(packet));
+      ++zeroCopySent;
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   void Link::await_completions()
+   {
+      socket.async_wait(ip::udp::socket::wait_error, [this](const boost::system::error_code& error) {
+         if (error) return;
+         // waiting again first, completions that arrive while the queue is read are not missed
+         await_completions();
+         read_completions();
+      });
+   }
+   // ------------------------------------------------------------------------
+   void Link::read_completions()
+   {
+      while (true) {
+         char control[CMSG_SPACE(sizeof(sock_extended_err) + sizeof(sockaddr_in6))];
+         msghdr msg{};
+         msg.msg_control = control;
+         msg.msg_controllen = sizeof(control);
+         if (recvmsg(socket.native_handle(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) return;
+
+         for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            const bool recvErr = (cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) || (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR);
+            if (!recvErr) continue;
+
+            sock_extended_err err;
+            std::memcpy(&err, CMSG_DATA(cmsg), sizeof(err));
+            if (err.ee_origin != SO_EE_ORIGIN_ZEROCOPY || err.ee_errno != 0) continue;
+
+            // the sends from ee_info to ee_data completed, the range may wrap around
+            const uint32_t first = err.ee_info;
+            const uint32_t last = err.ee_data;
+            if (err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+               zeroCopyCopied += last - first + 1;
+            }
+
+            std::unique_lock lock(zeroCopyMux);
+            if (first <= last) {
+               inFlight.erase(inFlight.lower_bound(first), inFlight.upper_bound(last));
+            } else {
+               inFlight.erase(inFlight.lower_bound(first), inFlight.end());
+               inFlight.erase(inFlight.begin(), inFlight.upper_bound(last));
+            }
+         }
+      }
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
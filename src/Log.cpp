@@ -0,0 +1,28 @@
+// ------------------------------------------------------------------------
+#include "Log.hpp"
+// ------------------------------------------------------------------------
+namespace rft::log
+{
+   // ------------------------------------------------------------------------
+   bool RateLimit::allow()
+   {
+      const int64_t now = chrono::duration_cast<timeunit>(chrono::steady_clock::now().time_since_epoch()).count();
+      int64_t due = next.load(std::memory_order_relaxed);
+      // only one of the threads that find the interval passed gets to log
+      if (now < due || !next.compare_exchange_strong(due, now + interval, std::memory_order_relaxed)) {
+         suppressed.fetch_add(1, std::memory_order_relaxed);
+         return false;
+      }
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   std::ostream& operator<<(std::ostream& os, const RateLimit& limit)
+   {
+      if (uint64_t count = limit.suppressed.exchange(0, std::memory_order_relaxed); count > 0) {
+         os << "(" << count << " similar suppressed) ";
+      }
+      return os;
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft::log
+// ------------------------------------------------------------------------
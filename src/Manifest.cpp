@@ -0,0 +1,193 @@
+// ------------------------------------------------------------------------
+#include "Manifest.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   Manifest Manifest::compute(int fd, uint64_t fileSize)
+   {
+      Manifest manifest;
+      manifest.fileSize = fileSize;
+      manifest.blockSize = block_size(manifest.fileSize);
+
+      std::vector<unsigned char> buffer(manifest.blockSize);
+      for (uint64_t offset = 0; offset < fileSize; offset += manifest.blockSize) {
+         const size_t numBytesRead = read_at(fd, offset, buffer.data(), std::min<uint64_t>(buffer.size(), fileSize - offset));
+         Block block;
+         block.weak = weak_checksum(buffer.data(), numBytesRead);
+         strong_checksum(buffer.data(), numBytesRead, block.strong);
+         manifest.blocks.push_back(block);
+      }
+
+      return manifest;
+   }
+   // ------------------------------------------------------------------------
+   std::optional<Manifest> Manifest::read(const std::string& filename)
+   {
+      std::ifstream file(filename, std::ios::in | std::ios::binary);
+
+      Manifest manifest;
+      file.read(reinterpret_cast<char*>(&manifest.fileSize), sizeof(manifest.fileSize));
+      file.read(reinterpret_cast<char*>(&manifest.blockSize), sizeof(manifest.blockSize));
+      if (!file) return std::nullopt;
+
+      manifest.fileSize = ntoh(manifest.fileSize);
+      manifest.blockSize = ntoh(manifest.blockSize);
+      if (manifest.blockSize == 0 || manifest.blockSize % CHUNK_SIZE != 0) return std::nullopt;
+
+      uint64_t blockCount = (manifest.fileSize + manifest.blockSize - 1) / manifest.blockSize;
+      if (blockCount != (std::filesystem::file_size(filename) - sizeof(manifest.fileSize) - sizeof(manifest.blockSize)) / (sizeof(uint32_t) + STRONG_SIZE)) {
+         return std::nullopt;
+      }
+
+      manifest.blocks.resize(blockCount);
+      for (auto& block: manifest.blocks) {
+         file.read(reinterpret_cast<char*>(&block.weak), sizeof(block.weak));
+         file.read(reinterpret_cast<char*>(block.strong), STRONG_SIZE);
+         block.weak = ntoh(block.weak);
+      }
+      if (!file) return std::nullopt;
+
+      return manifest;
+   }
+   // ------------------------------------------------------------------------
+   bool Manifest::write(const std::string& filename) const
+   {
+      std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+
+      uint64_t size = hton(fileSize);
+      uint32_t block = hton(blockSize);
+      file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      file.write(reinterpret_cast<const char*>(&block), sizeof(block));
+      for (auto& b: blocks) {
+         uint32_t weak = hton(b.weak);
+         file.write(reinterpret_cast<const char*>(&weak), sizeof(weak));
+         file.write(reinterpret_cast<const char*>(b.strong), STRONG_SIZE);
+      }
+
+      return static_cast<bool>(file.flush());
+   }
+   // ------------------------------------------------------------------------
+   std::vector<int64_t> Manifest::match(const std::string& basis) const
+   {
+      std::vector<int64_t> offsets(blocks.size(), -1);
+      const size_t L = blockSize;
+      const size_t fullBlocks = fileSize / blockSize;
+      if (fullBlocks == 0) return offsets;
+
+      // blocks by weak checksum, the filter saves most lookups while rolling over data that did not match
+      std::unordered_map<uint32_t, std::vector<uint32_t>> candidates;
+      std::vector<uint64_t> filter((1U << FILTER_BITS) / 64);
+      auto slot = [](uint32_t weak) { return (weak * 2654435761U) >> (32 - FILTER_BITS); };
+      for (uint32_t i = 0; i < fullBlocks; ++i) {
+         candidates[blocks[i].weak].push_back(i);
+         filter[slot(blocks[i].weak) / 64] |= 1ULL << (slot(blocks[i].weak) % 64);
+      }
+
+      std::ifstream file(basis, std::ios::in | std::ios::binary);
+      std::vector<unsigned char> buffer(std::max<size_t>(4 * L, 1 << 22));
+      size_t filled = 0;
+      size_t pos = 0;
+      uint64_t base = 0;
+
+      // keeps the bytes from pos on and reads as many as fit behind them
+      auto refill = [&]() {
+         std::memmove(buffer.data(), buffer.data() + pos, filled - pos);
+         base += pos;
+         filled -= pos;
+         pos = 0;
+         file.read(reinterpret_cast<char*>(buffer.data() + filled), buffer.size() - filled);
+         filled += file.gcount();
+      };
+
+      bool rolling = false;
+      uint32_t a = 0;
+      uint32_t b = 0;
+      while (true) {
+         if (pos + L > filled) {
+            refill();
+            if (pos + L > filled) break;
+         }
+
+         if (!rolling) {
+            a = 0;
+            b = 0;
+            for (size_t i = 0; i < L; ++i) {
+               a += buffer[pos + i];
+               b += (L - i) * buffer[pos + i];
+            }
+            rolling = true;
+         }
+
+         uint32_t weak = (a & 0xFFFF) | (b << 16);
+         if (filter[slot(weak) / 64] & (1ULL << (slot(weak) % 64))) {
+            auto search = candidates.find(weak);
+            if (search != candidates.end()) {
+               unsigned char strong[STRONG_SIZE];
+               strong_checksum(&buffer[pos], L, strong);
+
+               bool matched = false;
+               for (uint32_t idx: search->second) {
+                  if (offsets[idx] < 0 && std::memcmp(blocks[idx].strong, strong, STRONG_SIZE) == 0) {
+                     offsets[idx] = base + pos;
+                     matched = true;
+                  }
+               }
+               if (matched) {
+                  // continue behind the matched block (c.f. rsync)
+                  pos += L;
+                  rolling = false;
+                  continue;
+               }
+            }
+         }
+
+         // roll the window by one byte
+         if (pos + L >= filled) {
+            refill();
+            if (pos + L >= filled) break;
+         }
+         uint32_t out = buffer[pos];
+         uint32_t in = buffer[pos + L];
+         a = a - out + in;
+         b = b - L * out + a;
+         ++pos;
+      }
+
+      return offsets;
+   }
+   // ------------------------------------------------------------------------
+   uint32_t Manifest::block_size(uint64_t fileSize)
+   {
+      auto size = static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(fileSize))));
+      size = (size + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE;
+      return std::clamp<uint64_t>(size, MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
+   }
+   // ------------------------------------------------------------------------
+   uint32_t Manifest::weak_checksum(const unsigned char* data, size_t size)
+   {
+      uint32_t a = 0;
+      uint32_t b = 0;
+      for (size_t i = 0; i < size; ++i) {
+         a += data[i];
+         b += (size - i) * data[i];
+      }
+      return (a & 0xFFFF) | (b << 16);
+   }
+   // ------------------------------------------------------------------------
+   void Manifest::strong_checksum(const unsigned char* data, size_t size, unsigned char ret[STRONG_SIZE])
+   {
+      unsigned char sha256[SHA256_SIZE];
+      compute_SHA256(const_cast<unsigned char*>(data), size, sha256);
+      std::memcpy(ret, sha256, STRONG_SIZE);
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
@@ -0,0 +1,114 @@
+// ------------------------------------------------------------------------
+#include "Metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   Histogram::Histogram(std::vector<double> bounds)
+       : bounds(std::move(bounds)), buckets(new std::atomic<uint64_t>[this->bounds.size()]())
+   {}
+   // ------------------------------------------------------------------------
+   void Histogram::observe(double value)
+   {
+      auto bucket = std::lower_bound(bounds.begin(), bounds.end(), value);
+      if (bucket != bounds.end()) {
+         buckets[bucket - bounds.begin()].fetch_add(1, std::memory_order_relaxed);
+      }
+      count.fetch_add(1, std::memory_order_relaxed);
+      sum.fetch_add(value, std::memory_order_relaxed);
+   }
+   // ------------------------------------------------------------------------
+   std::string Exposition::with(const std::string& extra) const
+   {
+      if (labels.empty() && extra.empty()) return "";
+      if (labels.empty() || extra.empty()) return "{" + labels + extra + "}";
+      return "{" + labels + "," + extra + "}";
+   }
+   // ------------------------------------------------------------------------
+   std::string Exposition::escape(const std::string& value)
+   {
+      std::string escaped;
+      for (char c: value) {
+         if (c == '\\' || c == '"') escaped += '\\';
+         if (c == '\n') {
+            escaped += "\\n";
+            continue;
+         }
+         escaped += c;
+      }
+      return escaped;
+   }
+   // ------------------------------------------------------------------------
+   void Exposition::value(double value)
+   {
+      // counters and sizes are printed exactly instead of in scientific notation
+      if (std::floor(value) == value && std::abs(value) < 1e15) {
+         out << static_cast<int64_t>(value) << "\n";
+      } else {
+         out << value << "\n";
+      }
+   }
+   // ------------------------------------------------------------------------
+   void Exposition::family(const std::string& name, const std::string& type, const std::string& help)
+   {
+      out << "# HELP " << name << " " << help << "\n";
+      out << "# TYPE " << name << " " << type << "\n";
+   }
+   // ------------------------------------------------------------------------
+   void Exposition::sample(const std::string& name, const std::string& extra, double value)
+   {
+      out << name << with(extra) << " ";
+      this->value(value);
+   }
+   // ------------------------------------------------------------------------
+   void Exposition::counter(const std::string& name, const std::string& help, uint64_t value)
+   {
+      family(name, "counter", help);
+      out << name << with("") << " " << value << "\n";
+   }
+   // ------------------------------------------------------------------------
+   void Exposition::gauge(const std::string& name, const std::string& help, double value)
+   {
+      family(name, "gauge", help);
+      sample(name, "", value);
+   }
+   // ------------------------------------------------------------------------
+   void Exposition::histogram(const std::string& name, const std::string& help, const Histogram& histogram)
+   {
+      family(name, "histogram", help);
+
+      // the buckets of the exposition are cumulative
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i < histogram.bounds.size(); ++i) {
+         cumulative += histogram.buckets[i].load(std::memory_order_relaxed);
+         std::ostringstream le;
+         le << "le=\"" << histogram.bounds[i] << "\"";
+         out << name << "_bucket" << with(le.str()) << " " << cumulative << "\n";
+      }
+      const uint64_t count = histogram.count.load(std::memory_order_relaxed);
+      out << name << "_bucket" << with("le=\"+Inf\"") << " " << count << "\n";
+      out << name << "_sum" << with("") << " ";
+      value(histogram.sum.load(std::memory_order_relaxed));
+      out << name << "_count" << with("") << " " << count << "\n";
+   }
+   // ------------------------------------------------------------------------
+   bool Exposition::write(const std::string& path, const std::string& page)
+   {
+      std::string tmp = path + ".tmp";
+      {
+         std::ofstream file(tmp, std::ios::out | std::ios::trunc);
+         file << page;
+         if (!file) return false;
+      }
+
+      std::error_code ec;
+      std::filesystem::rename(tmp, path, ec);
+      return !ec;
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
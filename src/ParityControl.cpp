@@ -0,0 +1,26 @@
+// ------------------------------------------------------------------------
+#include "ParityControl.hpp"
+#include <cmath>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   void ParityControl::addSample(uint16_t chunksLost, uint16_t windowSize)
+   {
+      if (windowSize == 0) return;
+
+      double sample = std::min(1.0, static_cast<double>(chunksLost) / windowSize);
+      lossRate = (1 - ALPHA) * lossRate + ALPHA * sample;
+   }
+   // ------------------------------------------------------------------------
+   uint16_t ParityControl::getParityGroups(uint16_t windowSize) const
+   {
+      if (lossRate < MIN_LOSS_RATE) return 0;
+
+      // a group can only recover a single loss, it is kept small enough that two losses in a group are rare
+      auto groupSize = static_cast<uint16_t>(std::clamp(1 / (2 * lossRate), static_cast<double>(MIN_GROUP_SIZE), static_cast<double>(MAX_GROUP_SIZE)));
+      return (windowSize + groupSize - 1) / groupSize;
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
@@ -0,0 +1,117 @@
+// ------------------------------------------------------------------------
+#include "ReadCache.hpp"
+#include "Compression.hpp"
+#include "util.hpp"
+#include <sys/stat.h>
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   ReadCache::ReadCache(size_t budget) : shardBudget(budget / SHARDS) {}
+   // ------------------------------------------------------------------------
+   static std::optional<ReadCache::FileId> file_id(const struct stat& st)
+   {
+      if (!S_ISREG(st.st_mode)) return std::nullopt;
+      return ReadCache::FileId{static_cast<uint64_t>(st.st_dev), static_cast<uint64_t>(st.st_ino),
+                               static_cast<int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec, static_cast<uint64_t>(st.st_size)};
+   }
+   // ------------------------------------------------------------------------
+   std::optional<ReadCache::FileId> ReadCache::identify(int fd)
+   {
+      struct stat st {};
+      if (fstat(fd, &st) != 0) return std::nullopt;
+      return file_id(st);
+   }
+   // ------------------------------------------------------------------------
+   std::optional<ReadCache::FileId> ReadCache::identify(const std::string& path)
+   {
+      struct stat st {};
+      if (stat(path.c_str(), &st) != 0) return std::nullopt;
+      return file_id(st);
+   }
+   // ------------------------------------------------------------------------
+   std::shared_ptr<const ReadCache::Block> ReadCache::get(const FileId& file, uint64_t block, int fd)
+   {
+      Key key{file, block};
+      auto& shard = shards[KeyHash{}(key) % SHARDS];
+
+      std::promise<std::shared_ptr<const Block>> loaded;
+      {
+         std::unique_lock lock(shard.mux);
+         auto search = shard.blocks.find(key);
+         if (search != shard.blocks.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, search->second);
+            return search->second->second;
+         }
+         auto reading = shard.pending.find(key);
+         if (reading != shard.pending.end()) {
+            auto future = reading->second;
+            lock.unlock();
+            return future.get();
+         }
+         shard.pending.emplace(key, loaded.get_future().share());
+      }
+
+      // the disk is read without holding the lock, other blocks of the shard are served in the meantime
+      auto data = std::make_shared<Block>(BLOCK_SIZE);
+      data->data.resize(read_at(fd, block * BLOCK_SIZE, data->data.data(), BLOCK_SIZE));
+
+      std::unique_lock lock(shard.mux);
+      shard.pending.erase(key);
+      if (data->data.empty()) {
+         loaded.set_value(nullptr);
+         return nullptr;
+      }
+      loaded.set_value(data);
+
+      shard.lru.emplace_front(key, data);
+      shard.blocks.emplace(key, shard.lru.begin());
+      shard.used += BLOCK_SIZE;
+
+      while (shard.used > shardBudget && !shard.lru.empty()) {
+         shard.blocks.erase(shard.lru.back().first);
+         shard.lru.pop_back();
+         shard.used -= BLOCK_SIZE;
+      }
+
+      return data;
+   }
+   // ------------------------------------------------------------------------
+   const std::vector<unsigned char>& ReadCache::Block::compressed(uint16_t chunk) const
+   {
+      std::call_once(compressOnce, [this]() {
+         chunks.resize((data.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+         for (size_t i = 0; i < chunks.size(); ++i) {
+            const size_t size = std::min<size_t>(CHUNK_SIZE, data.size() - i * CHUNK_SIZE);
+            if (!lz::is_compressible(&data[i * CHUNK_SIZE], size)) continue;
+
+            // same threshold as for batches of chunks
+            unsigned char out[CHUNK_SIZE];
+            size_t outSize = 0;
+            if (lz::compress_chunks(&data[i * CHUNK_SIZE], size, out, CHUNK_SIZE, outSize) == size && outSize < size * 7 / 8) {
+               chunks[i].assign(out, out + outSize);
+            }
+         }
+      });
+      return chunks[chunk];
+   }
+   // ------------------------------------------------------------------------
+   size_t ReadCache::FileIdHash::operator()(const FileId& file) const
+   {
+      // boost::hash_combine
+      size_t seed = 0;
+      for (uint64_t value: {file.device, file.inode, static_cast<uint64_t>(file.mtime), file.size}) {
+         seed ^= std::hash<uint64_t>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+      }
+      return seed;
+   }
+   // ------------------------------------------------------------------------
+   size_t ReadCache::KeyHash::operator()(const Key& key) const
+   {
+      size_t seed = FileIdHash{}(key.file);
+      seed ^= std::hash<uint64_t>{}(key.block) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+      return seed;
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
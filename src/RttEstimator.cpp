@@ -0,0 +1,40 @@
+// ------------------------------------------------------------------------
+#include "RttEstimator.hpp"
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   void RttEstimator::addSample(timeunit rtt)
+   {
+      // a zero sample would mark the estimator as uninitialized
+      rtt = std::max(rtt, timeunit(1));
+
+      if (!hasSample()) {
+         srtt = rtt;
+         rttvar = rtt / 2;
+      } else {
+         auto delta = srtt > rtt ? srtt - rtt : rtt - srtt;
+         rttvar = chrono::duration_cast<timeunit>((1 - BETA) * rttvar + BETA * delta);
+         srtt = chrono::duration_cast<timeunit>((1 - ALPHA) * srtt + ALPHA * rtt);
+      }
+
+      // a new sample from an unambiguous response collapses the backoff
+      backoffs = 0;
+   }
+   // ------------------------------------------------------------------------
+   void RttEstimator::backoff()
+   {
+      backoffs = std::min<uint8_t>(backoffs + 1, MAX_BACKOFFS);
+   }
+   // ------------------------------------------------------------------------
+   timeunit RttEstimator::rto() const
+   {
+      timeunit rto = INITIAL_RTO;
+      if (hasSample()) {
+         rto = std::clamp(srtt + std::max(GRANULARITY, K * rttvar), MIN_RTO, MAX_RTO);
+      }
+      return std::min(rto * (1 << backoffs), MAX_RTO);
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
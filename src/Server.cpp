@@ -1,33 +1,68 @@
 // ------------------------------------------------------------------------
 #include "Server.hpp"
 #include "Bitfield.hpp"
+#include "Compression.hpp"
+#include "Log.hpp"
 #include "CongestionControl.hpp"
+#include "Manifest.hpp"
+#include "Trace.hpp"
+#include "Wire.hpp"
+#include <array>
 #include <boost/bind/bind.hpp>
-#include <filesystem>
-#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
 // ------------------------------------------------------------------------
 namespace rft
 {
    // ------------------------------------------------------------------------
-   Server::Server(const size_t port, double p, double q)
-       : socket(io_context, ip::udp::endpoint(ip::udp::v4(), port)), port(port), p(p), q(q) {}
+   Server::Server(const size_t port, const LinkConfig& link, bool useReputation, size_t cacheSize, bool zeroCopy, const std::string& metricsFile)
+       : socket(make_strand(io_context), ip::udp::endpoint(ip::udp::v4(), port)), link(socket, link), port(port), difficultyControl(useReputation), cache(cacheSize), metricsFile(metricsFile)
+   {
+      // chunks are only sent without a copy from the cache, which keeps them alive while the kernel reads them
+      if (zeroCopy && !cache.enabled()) {
+         PLOG_WARNING << "[Server] Zero-copy sends need the cache, chunks are copied";
+      } else if (zeroCopy && !this->link.enable_zerocopy()) {
+         PLOG_WARNING << "[Server] The kernel does not support zero-copy sends, chunks are copied";
+      }
+   }
    // ------------------------------------------------------------------------
-   Server::~Server() { stop(); }
+   Server::~Server()
+   {
+      stop();
+      shutdown();
+   }
    // ------------------------------------------------------------------------
    void Server::start()
    {
+      running = true;
+      if (!metricsFile.empty()) {
+         metricsTimer.setTimeout(METRICS_INTERVAL, boost::bind(&Server::export_metrics, this));
+      }
       receive_msg();
       thread_context = std::thread([this]() { io_context.run(); });
-      PLOG_INFO << "[Server] Started on port " + std::to_string(port) + "!";
+      PLOG_INFO << "[Server] Started on port " << port << "!";
 
       process_msgs();
+      shutdown();
    }
    // ------------------------------------------------------------------------
    void Server::stop()
    {
+      running = false;
+      msgQueue.wake();
+   }
+   // ------------------------------------------------------------------------
+   void Server::shutdown()
+   {
+      // the tasks of the workers and readers refer to the server, they are finished before it goes away
+      readers.join();
+      workers.join();
       io_context.stop();
-      if (thread_context.joinable()) thread_context.join();
-      PLOG_INFO << "[Server] Stopped!";
+      if (thread_context.joinable()) {
+         thread_context.join();
+         PLOG_INFO << "[Server] Stopped!";
+      }
    }
    // ------------------------------------------------------------------------
    void Server::receive_msg()
@@ -45,31 +80,27 @@ namespace rft
          // PLOG_VERBOSE << "[Server] Received message";
          enqueue_msg(bytes_transferred);
       } else {
-         PLOG_WARNING << "[Server] Error on Receive: " + error.to_string();
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Server] Error on Receive: " << error.message();
       }
    }
    // ------------------------------------------------------------------------
    void Server::send_msg_to_client(Message<ServerMsgType> msg, const ip::udp::endpoint& client)
    {
-      switch (packetLossState) {
-         case PacketLossState::LOST:
-            if (rft::random() < q) {
-               return;
-            }
-            packetLossState = PacketLossState::NOT_LOST;
-            break;
-         case PacketLossState::NOT_LOST:
-            if (rft::random() < p) {
-               packetLossState = PacketLossState::LOST;
-               return;
-            }
-            break;
-      }
-
-      socket.async_send_to(buffer(msg.packet, msg.header.size), client,
-                           boost::bind(&Server::handle_send, this,
-                                       boost::asio::placeholders::error,
-                                       boost::asio::placeholders::bytes_transferred));
+      send_msg_to_client(std::make_shared<const Message<ServerMsgType>>(std::move(msg)), client);
+   }
+   // ------------------------------------------------------------------------
+   void Server::send_msg_to_client(std::shared_ptr<const Message<ServerMsgType>> msg, const ip::udp::endpoint& client)
+   {
+      ++counters.packetsSent;
+      counters.bytesSent += msg->header.size;
+      if (trace::enabled()) trace::packet(trace::Source::SERVER, trace::EventType::PACKET_SENT, msg->packet, msg->header.size);
+
+      // the main thread and the workers send, the socket is only used on its strand, where it also receives
+      dispatch(socket.get_executor(), [this, msg, client]() {
+         link.send(msg->packet, msg->header.size, client, [this, msg](const boost::system::error_code& error, size_t bytes_transferred) {
+            handle_send(error, bytes_transferred);
+         });
+      });
    }
    // ------------------------------------------------------------------------
    void Server::handle_send(const boost::system::error_code& error, size_t bytes_transferred)
@@ -77,13 +108,16 @@ namespace rft
       if (!error) {
          // PLOG_VERBOSE << "[Server] Send message";
       } else {
-         PLOG_WARNING << "[Server] Error on Send: " + error.to_string();
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Server] Error on Send: " << error.message();
       }
    }
    // ------------------------------------------------------------------------
    void Server::enqueue_msg(size_t bytes_transferred)
    {
       decode_msg(bytes_transferred);
+      ++counters.packetsReceived;
+      counters.bytesReceived += bytes_transferred;
+      if (trace::enabled()) trace::packet(trace::Source::SERVER, trace::EventType::PACKET_RECEIVED, msgIn.packet, bytes_transferred);
       msgQueue.push_back(msgIn);
 
       receive_msg();
@@ -102,12 +136,13 @@ namespace rft
    // ------------------------------------------------------------------------
    void Server::process_msgs()
    {
-      while (true) {
-         msgQueue.wait();
+      while (running) {
+         msgQueue.wait(timers.advance());
 
          while (!msgQueue.empty()) {
             auto msg = msgQueue.pop_front();
             dispatch_msg(msg);
+            timers.advance();
          }
       }
    }
@@ -121,7 +156,8 @@ namespace rft
             break;
          case CLIENT_VALIDATION_RESPONSE:
             // validating the response is a time-consuming operation, do not block the main thread for this (otherwise timeouts for file transfers that are already in progress will fire)
-            post(boost::bind(&Server::handle_validation_response, this, msg));
+            ++pendingValidations;
+            post(workers, boost::bind(&Server::handle_validation_response, this, msg));
             break;
          case TRANSMISSION_REQUEST:
             handle_transmission_request(msg);
@@ -136,28 +172,34 @@ namespace rft
             break;
          // Ignore unknown packets
          default:
-            PLOG_VERBOSE << "[Server] Dropping unknown packet.";
+            RFT_LOG(plog::verbose) << "[Server] Dropping unknown packet.";
             return;
       }
    }
    // ------------------------------------------------------------------------
    void Server::handle_file_request(Message<ClientMsgType>& msg)
    {
-      uint32_t filenameSize = msg.header.size - (sizeof(ClientMsgType) + 1);
+      auto request = wire::FileRequest::parse(wire::bytes(msg));
+      if (!request) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Server] Dropping malformed File Request";
+         return;
+      }
+      const std::string_view filename = request->filename;
 
-      unsigned char hash1[SHA256_SIZE];
-      unsigned char hash2[SHA256_SIZE];
+      wire::Hash hash1;
+      wire::Hash hash2;
       uint32_t nonce = chrono::duration_cast<seconds>(NOW.time_since_epoch()).count();
-      std::string filename(filenameSize, '\0');
 
-      msg >> filename;
+      std::string str = std::to_string(nonce);
+      str.append(filename).append(SERVER_SECRET);
+      compute_SHA256(reinterpret_cast<unsigned char*>(str.data()), str.size(), hash1.data());
+      compute_SHA256(hash1.data(), SHA256_SIZE, hash2.data());
 
-      std::string str(std::to_string(nonce) + filename + SERVER_SECRET);
-      compute_SHA256(reinterpret_cast<unsigned char*>(str.data()), str.size(), hash1);
-      compute_SHA256(hash1, SHA256_SIZE, hash2);
+      // push the cost of a handshake onto the requesters when the server is under load
+      uint8_t difficulty = difficultyControl.getDifficulty(msg.header.remote.address(), msgQueue.count(), pendingValidations);
 
       // mask difficulty-number of bits from hash1
-      uint8_t remaining = DIFFICULTY;
+      uint8_t remaining = difficulty;
       uint8_t byte = SHA256_SIZE - 1;
       while (remaining >= 8) {
          hash1[byte] = 0;
@@ -167,50 +209,39 @@ namespace rft
       hash1[byte] &= 0b11111111 << remaining;
 
       Message<ServerMsgType> msgOut;
-      msgOut.header.type = SERVER_VALIDATION_REQUEST;
-      msgOut.header.size = 0;
       msgOut.header.remote = socket.local_endpoint();
+      wire::ValidationRequest::encode(msgOut, difficulty, hash1, hash2, nonce, filename);
 
-      msgOut << SERVER_VALIDATION_REQUEST;
-      msgOut << DIFFICULTY;
-      msgOut << hash1;
-      msgOut << hash2;
-      msgOut << nonce;
-      msgOut << filename;
-
-      PLOG_INFO << "[Server] Client requesting file: " << filename;
+      // file requests cost the server nothing but this statement, which must not make flooding it cheaper
+      RFT_LOG_EVERY(plog::info, seconds(1)) << "[Server] Client requesting file: " << filename;
 
       send_msg_to_client(msgOut, msg.header.remote);
    }
    // ------------------------------------------------------------------------
    void Server::handle_validation_response(Message<ClientMsgType>& msg)
    {
-      uint32_t filenameSize = msg.header.size - CLIENT_VALIDATION_RESPONSE_META_DATA_SIZE;
+      --pendingValidations;
+      auto start = NOW;
 
-      unsigned char hash1[SHA256_SIZE];
-      unsigned char originalHash1[SHA256_SIZE];
-      uint32_t nonce;
-      uint16_t maxThroughput;
-      std::string filename(filenameSize, '\0');
-
-      msg >> filename;
-      msg >> maxThroughput;
-      msg >> nonce;
-      msg >> hash1;
+      auto response = wire::ValidationResponse::parse(wire::bytes(msg));
+      if (!response) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Server] Dropping malformed Validation Response";
+         return;
+      }
+      const uint16_t maxThroughput = response->maxThroughput;
+      const uint8_t capabilities = response->capabilities;
+      std::string filename(response->filename);
 
       // verify solution
-      std::string str(std::to_string(nonce) + filename + SERVER_SECRET);
+      unsigned char originalHash1[SHA256_SIZE];
+      std::string str(std::to_string(response->nonce) + filename + SERVER_SECRET);
       compute_SHA256(reinterpret_cast<unsigned char*>(str.data()), str.size(), originalHash1);
-      if (std::strncmp(reinterpret_cast<char*>(originalHash1), reinterpret_cast<char*>(hash1), SHA256_SIZE) != 0) {
-         PLOG_WARNING << "[Server] Client did not pass validation for file: " << filename;
+      if (std::memcmp(originalHash1, response->hash1.data(), SHA256_SIZE) != 0) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Server] Client did not pass validation for file: " << filename;
 
          Message<ServerMsgType> msgOut;
-         msgOut.header.type = ERROR_CLIENT_VALIDATION_FAILED;
-         msgOut.header.size = 0;
          msgOut.header.remote = socket.local_endpoint();
-
-         msgOut << ERROR_CLIENT_VALIDATION_FAILED;
-         msgOut << filename;
+         wire::FileError::encode(msgOut, ERROR_CLIENT_VALIDATION_FAILED, filename);
 
          send_msg_to_client(msgOut, msg.header.remote);
          return;
@@ -218,207 +249,553 @@ namespace rft
 
       PLOG_INFO << "[Server] Client has passed validation for file: " << filename;
 
-      std::ifstream file(filename, std::ios::in | std::ios::binary);
-      if (!file) {
+      // Lost chunks are read from the file again, only regular files can be served
+      auto file = files.open(filename);
+      if (file == nullptr) {
          PLOG_WARNING << "[Server] File: " << filename << " does not exist!";
          Message<ServerMsgType> msgOut;
-         msgOut.header.type = ERROR_FILE_NOT_FOUND;
-         msgOut.header.size = 0;
          msgOut.header.remote = socket.local_endpoint();
-
-         msgOut << ERROR_FILE_NOT_FOUND;
-         msgOut << filename;
+         wire::FileError::encode(msgOut, ERROR_FILE_NOT_FOUND, filename);
 
          send_msg_to_client(msgOut, msg.header.remote);
          return;
       }
 
-      ConnectionID connectionId = connectionIdPool++;
-      uint64_t fileSize = std::filesystem::file_size(filename);
-      unsigned char sha256[SHA256_SIZE];
-      compute_file_SHA256(filename, sha256);
-      Window window(maxThroughput * 1024 * 1024 / CHUNK_SIZE);
+      // the manifest is announced ahead of the file, the client knows which blocks it has once the file's connection starts. Smaller
+      // files are transferred whole.
+      if ((capabilities & CAPABILITY_MANIFEST) && file->size() >= Manifest::MIN_BLOCK_SIZE) {
+         open_manifest(*file, filename, maxThroughput, capabilities, msg.header.remote);
+      }
+
+      // computed once per version of the file, later connections only wait for it if it is still being computed
+      const uint64_t fileSize = file->size();
+      const wire::Hash& sha256 = file->sha256();
 
-      connections.insert({connectionId, Connection{msg.header.remote, std::move(file), maxThroughput, std::move(window), io_context}});
+      const ReadCache::FileId fileId = file->id;
+      auto newConnectionId = connections.emplace(msg.header.remote, std::move(file), fileId, maxThroughput, capabilities, timers);
+      if (!newConnectionId) {
+         // the client repeats its Validation Response once the timeout expires
+         PLOG_WARNING << "[Server] Connection table is full, dropping request for file: " << filename;
+         return;
+      }
+      ConnectionID connectionId = *newConnectionId;
+      ++counters.connectionsOpened;
 
       Message<ServerMsgType> msgOut;
-      msgOut.header.type = SERVER_INITIAL_RESPONSE;
-      msgOut.header.size = 0;
       msgOut.header.remote = socket.local_endpoint();
+      wire::InitialResponse::encode(msgOut, connectionId, fileSize, sha256, filename);
 
-      msgOut << SERVER_INITIAL_RESPONSE;
-      msgOut << connectionId;
-      msgOut << fileSize;
-      msgOut << sha256;
-      msgOut << filename;
-
-      auto& conn = connections.at(connectionId);
+      auto& conn = *connections.find(connectionId);
+      conn.transfers = count_transfer(fileId);
       conn.timer.setTimeout(minutes(TIMEOUT), boost::bind(&Server::handle_timeout, this, connectionId));
+      handshakeProcessing.observe(chrono::duration<double>(NOW - start).count());
       send_msg_to_client(msgOut, msg.header.remote);
    }
    // ------------------------------------------------------------------------
-   void Server::handle_transmission_request(Message<ClientMsgType>& msg)
+   void Server::open_manifest(const FileCache::File& file, const std::string& filename, uint16_t maxThroughput, uint8_t capabilities,
+                              const ip::udp::endpoint& client)
    {
-      ConnectionID connectionId;
-      uint8_t windowId;
-      uint32_t rttCurrent;
-      uint32_t chunkIdx;
+      // computed once per version of the file and served like a regular file, e.g., to every client that reconnects
+      auto manifest = file.manifest();
+      if (manifest == nullptr) {
+         PLOG_WARNING << "[Server] Could not create manifest for file: " << filename;
+         return;
+      }
 
-      msg >> chunkIdx;
-      msg >> rttCurrent;
-      msg >> windowId;
-      msg >> connectionId;
+      const uint64_t size = manifest->size();
+      const wire::Hash& sha256 = manifest->sha256();
+      auto connectionId = connections.emplace(client, std::move(manifest), std::nullopt, maxThroughput, capabilities, timers);
+      if (!connectionId) {
+         PLOG_WARNING << "[Server] Connection table is full, dropping manifest of file: " << filename;
+         return;
+      }
+      ++counters.connectionsOpened;
+      connections.find(*connectionId)->timer.setTimeout(minutes(TIMEOUT), boost::bind(&Server::handle_timeout, this, *connectionId));
 
-      chunkIdx = chunkIdx;
-      rttCurrent = rttCurrent;
-      connectionId = connectionId;
+      Message<ServerMsgType> msgOut;
+      msgOut.header.remote = socket.local_endpoint();
+      wire::InitialResponse::encode(msgOut, *connectionId, size, sha256, filename, SERVER_MANIFEST_RESPONSE);
+      send_msg_to_client(msgOut, client);
+   }
+   // ------------------------------------------------------------------------
+   void Server::handle_transmission_request(Message<ClientMsgType>& msg)
+   {
+      auto request = wire::TransmissionRequest::parse(wire::bytes(msg));
+      if (!request) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Server] Dropping malformed Transmission Request";
+         return;
+      }
+      const ConnectionID connectionId = request->connectionId;
+      const uint8_t windowId = request->windowId;
+      const uint32_t chunkIdx = request->chunkIdx;
 
       auto search = connections.find(connectionId);
-      if (search == connections.end()) {
-         PLOG_WARNING << "No connection for: " << connectionId;
+      if (search == nullptr) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Server] No connection for: " << connectionId;
 
          Message<ServerMsgType> msgOut;
-         msgOut.header.type = ERROR_CONNECTION_NOT_FOUND;
-         msgOut.header.size = 0;
          msgOut.header.remote = socket.local_endpoint();
-
-         msgOut << ERROR_CONNECTION_NOT_FOUND;
-         msgOut << connectionId;
+         wire::ConnectionNotFound::encode(msgOut, ERROR_CONNECTION_NOT_FOUND, connectionId);
 
          send_msg_to_client(msgOut, msg.header.remote);
          return;
       }
-      auto& conn = search->second;
+      auto& conn = *search;
+      ++counters.transmissionRequests;
 
       // Connection Migration: Every time a request for a connection is received, update the endpoint information for that connection
       conn.client = msg.header.remote;
+
+      // a repeated request for the same window must not be counted twice
+      if (windowId != conn.window.id) {
+         conn.parity.addSample(request->chunksLost, conn.window.currentSize);
+      }
       conn.window.id = windowId;
 
-      PLOG_VERBOSE << "[Server] Transmission Request for connection ID " << connectionId << " at chunk index " << chunkIdx;
+      RFT_LOG(plog::verbose) << "[Server] Transmission Request for connection ID " << connectionId << " at chunk index " << chunkIdx;
 
       Message<ServerMsgType> msgOut;
-      msgOut.header.type = PAYLOAD;
       msgOut.header.remote = socket.local_endpoint();
 
-      conn.window.currentSize = conn.cc.getNextWindowSize(rttCurrent);
+      // the window never extends past the end of the file, so every packet of a window carries its final size
+      uint64_t fileChunks = (conn.fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+      uint64_t chunksLeft = fileChunks - std::min<uint64_t>(chunkIdx, fileChunks);
+      // the client limits the window to the chunks it does not have yet, 0 places no limit
+      if (request->chunkCount > 0) {
+         chunksLeft = std::min<uint64_t>(chunksLeft, request->chunkCount);
+      }
+      conn.window.currentSize = std::max<uint64_t>(1, std::min<uint64_t>(conn.cc.getNextWindowSize(request->rtt), chunksLeft));
+      conn.window.chunkIdx = chunkIdx;
+      if (trace::enabled()) {
+         trace::record(trace::Source::SERVER, trace::EventType::CC_DECISION, connectionId, conn.cc.cwnd, conn.cc.rttCurrent, conn.cc.rttMax, static_cast<uint32_t>(conn.cc.phase));
+         trace::record(trace::Source::SERVER, trace::EventType::WINDOW_STARTED, connectionId, chunkIdx, conn.window.currentSize);
+      }
+
+      // chunk i is added to the parity of group i % groups, interleaving the groups spreads burst losses over them
+      const uint16_t groups = (conn.capabilities & CAPABILITY_FEC) ? conn.parity.getParityGroups(conn.window.currentSize) : 0;
+      std::vector<std::array<unsigned char, CHUNK_SIZE>> parities(groups);
+      std::vector<uint16_t> parityLengths(groups);
+      std::vector<uint16_t> paritySizes(groups);
+
+      // consecutive chunks that are compressed together on a worker thread
+      const bool compress = conn.capabilities & CAPABILITY_COMPRESSION;
+      // while other connections transfer the same file, its chunks are compressed once for all of them
+      const bool shared = compress && is_shared(conn);
+      std::vector<unsigned char> batch;
+      uint16_t batchStart = 0;
+      uint16_t batchCount = 0;
 
       if (conn.cc.phase == CongestionControl::Phase::CC_AVOIDANCE) {
          conn.cc.phase = CongestionControl::Phase::CC_NORMAL;
+         ++conn.phaseChanges;
+         ++counters.phaseChanges;
       }
 
-      // set offset into file
-      conn.file.seekg(chunkIdx * CHUNK_SIZE);
+      conn.timer.setTimeout(minutes(TIMEOUT));
+
       for (uint16_t i = 0; i < conn.window.currentSize; ++i) {
          // read chunk from file
          unsigned char buffer[CHUNK_SIZE];
-         conn.file.read(reinterpret_cast<char*>(buffer), CHUNK_SIZE);
-         const size_t numBytesRead = conn.file.gcount();
-         std::vector<unsigned char> chunk(std::begin(buffer), std::begin(buffer) + numBytesRead);
+         const Chunk chunk = read_chunk(conn, static_cast<uint64_t>(chunkIdx) + i, buffer);
+         const size_t numBytesRead = chunk.data.size();
 
          // Read the last chunk of the file
          if (numBytesRead < CHUNK_SIZE) {
             conn.window.currentSize = i + 1;
          }
 
-         msgOut.header.size = 0;
+         if (groups > 0) {
+            auto& parity = parities[i % groups];
+            for (size_t b = 0; b < numBytesRead; ++b) {
+               parity[b] ^= chunk.data[b];
+            }
+            parityLengths[i % groups] ^= numBytesRead;
+            paritySizes[i % groups] = std::max<uint16_t>(paritySizes[i % groups], numBytesRead);
+         }
 
-         msgOut << PAYLOAD;
-         msgOut << connectionId;
-         msgOut << conn.window.id;
-         msgOut << conn.window.currentSize;
-         msgOut << i;
-         msgOut << chunk;
+         if (shared) {
+            if (batchCount == 0) batchStart = i;
+            ++batchCount;
+            if ((static_cast<uint64_t>(chunkIdx) + i + 1) % ReadCache::BLOCK_CHUNKS == 0 || i + 1 == conn.window.currentSize) {
+               send_shared(conn, connectionId, batchStart, batchCount, msg.header.remote);
+               batchCount = 0;
+            }
+            continue;
+         }
 
-         conn.window.store_chunk(chunk, i);
+         if (compress) {
+            if (batchCount == 0) batchStart = i;
+            batch.insert(batch.end(), chunk.data.begin(), chunk.data.end());
+            ++batchCount;
+            if (batchCount == MAX_COMPRESSED_CHUNKS || i + 1 == conn.window.currentSize) {
+               post(workers, boost::bind(&Server::send_compressed, this, connectionId, conn.window.id, conn.window.currentSize, batchStart, batchCount, std::move(batch), msg.header.remote));
+               batch.clear();
+               batchCount = 0;
+            }
+            continue;
+         }
+
+         send_payload(msgOut, connectionId, conn, i, chunk, msg.header.remote);
+      }
 
-         conn.timer.setTimeout(minutes(TIMEOUT), boost::bind(&Server::handle_timeout, this, connectionId));
+      conn.chunksSent += conn.window.currentSize;
+      counters.chunksSent += conn.window.currentSize;
 
+      // the parity follows the data, a group is empty if the window was cut short by the end of the file
+      for (uint16_t g = 0; g < std::min(groups, conn.window.currentSize); ++g) {
+         wire::ParityPayload::encode(msgOut, connectionId, conn.window.id, conn.window.currentSize, g, groups, parityLengths[g], {parities[g].data(), paritySizes[g]});
          send_msg_to_client(msgOut, msg.header.remote);
       }
+
+      read_ahead(conn, request->chunkCount);
    }
    // ------------------------------------------------------------------------
    void Server::handle_finish(Message<ClientMsgType>& msg)
    {
-      ConnectionID connectionId;
-
-      msg >> connectionId;
+      auto finish = wire::FinishMessage::parse(wire::bytes(msg));
+      if (!finish) return;
+      const ConnectionID connectionId = finish->connectionId;
 
       PLOG_INFO << "[Server] Received Finish message for connection ID " << connectionId;
-      connections.erase(connectionId);
+      if (connections.erase(connectionId)) {
+         ++counters.connectionsClosed;
+      }
    }
    // ------------------------------------------------------------------------
    void Server::handle_retransmission_request(Message<ClientMsgType>& msg)
    {
-      uint16_t payloadSize = msg.header.size - (sizeof(ClientMsgType) + sizeof(ConnectionID) + sizeof(uint8_t));
-
-      ConnectionID connectionId;
-      uint8_t windowId;
-      std::vector<unsigned char> payload(payloadSize);
-
-      msg >> payload;
-      msg >> windowId;
-      msg >> connectionId;
+      auto request = wire::RetransmissionRequest::parse(wire::bytes(msg));
+      if (!request) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Server] Dropping malformed Retransmission Request";
+         return;
+      }
+      const ConnectionID connectionId = request->connectionId;
 
-      PLOG_INFO << "[Server] Received Retransmission Request for connection ID " << connectionId;
+      RFT_LOG(plog::debug) << "[Server] Received Retransmission Request for connection ID " << connectionId;
 
       auto search = connections.find(connectionId);
-      if (search == connections.end()) {
-         PLOG_WARNING << "No connection for: " << connectionId;
+      if (search == nullptr) {
+         RFT_LOG_EVERY(plog::warning, seconds(1)) << "[Server] No connection for: " << connectionId;
 
          Message<ServerMsgType> msgOut;
-         msgOut.header.type = ERROR_CONNECTION_NOT_FOUND;
-         msgOut.header.size = 0;
          msgOut.header.remote = socket.local_endpoint();
-
-         msgOut << ERROR_CONNECTION_NOT_FOUND;
-         msgOut << connectionId;
+         wire::ConnectionNotFound::encode(msgOut, ERROR_CONNECTION_NOT_FOUND, connectionId);
 
          send_msg_to_client(msgOut, msg.header.remote);
          return;
       }
-      auto& conn = search->second;
+      auto& conn = *search;
+      ++counters.retransmissionRequests;
 
-      conn.cc.phase = CongestionControl::Phase::CC_AVOIDANCE;
+      if (conn.cc.phase != CongestionControl::Phase::CC_AVOIDANCE) {
+         conn.cc.phase = CongestionControl::Phase::CC_AVOIDANCE;
+         ++conn.phaseChanges;
+         ++counters.phaseChanges;
+      }
 
       // Connection Migration: Every time a request for a connection is received, update the endpoint information for that connection
       conn.client = msg.header.remote;
 
       Bitfield bitfield(conn.window.currentSize);
-      bitfield.from(payload.data());
+      bitfield.from(request->bitfield.data(), request->bitfield.size());
+
+      conn.timer.setTimeout(minutes(TIMEOUT));
 
       Message<ServerMsgType> msgOut;
-      msgOut.header.type = PAYLOAD;
       msgOut.header.remote = socket.local_endpoint();
 
-      for (uint16_t i = 0; i < conn.window.currentSize; ++i) {
-         if (!bitfield[i]) {
-            msgOut.header.size = 0;
+      // runs of consecutive lost chunks are compressed together
+      const bool compress = conn.capabilities & CAPABILITY_COMPRESSION;
+      const bool shared = compress && is_shared(conn);
+      std::vector<unsigned char> batch;
+      uint16_t batchStart = 0;
+      uint16_t batchCount = 0;
+
+      uint32_t retransmitted = 0;
+      for (uint16_t i = bitfield.find_next_unset(0); i < conn.window.currentSize; i = bitfield.find_next_unset(i + 1)) {
+         ++retransmitted;
+         ++conn.chunksRetransmitted;
+         ++counters.chunksRetransmitted;
+
+         if (shared) {
+            if (batchCount == 0) batchStart = i;
+            ++batchCount;
+            uint16_t next = bitfield.find_next_unset(i + 1);
+            if ((static_cast<uint64_t>(conn.window.chunkIdx) + i + 1) % ReadCache::BLOCK_CHUNKS == 0 || next != i + 1 || next >= conn.window.currentSize) {
+               send_shared(conn, connectionId, batchStart, batchCount, msg.header.remote);
+               batchCount = 0;
+            }
+            continue;
+         }
+
+         // read the lost chunk again, usually from the cache
+         unsigned char buffer[CHUNK_SIZE];
+         const Chunk chunk = read_chunk(conn, static_cast<uint64_t>(conn.window.chunkIdx) + i, buffer);
+
+         if (compress) {
+            if (batchCount == 0) batchStart = i;
+            batch.insert(batch.end(), chunk.data.begin(), chunk.data.end());
+            ++batchCount;
+            uint16_t next = bitfield.find_next_unset(i + 1);
+            if (batchCount == MAX_COMPRESSED_CHUNKS || next != i + 1 || next >= conn.window.currentSize) {
+               post(workers, boost::bind(&Server::send_compressed, this, connectionId, conn.window.id, conn.window.currentSize, batchStart, batchCount, std::move(batch), msg.header.remote));
+               batch.clear();
+               batchCount = 0;
+            }
+            continue;
+         }
+
+         send_payload(msgOut, connectionId, conn, i, chunk, msg.header.remote);
+      }
+
+      if (trace::enabled()) trace::record(trace::Source::SERVER, trace::EventType::RETRANSMISSION, connectionId, retransmitted);
+   }
+   // ------------------------------------------------------------------------
+   Server::Chunk Server::read_chunk(Connection& conn, uint64_t chunkIdx, unsigned char buffer[CHUNK_SIZE])
+   {
+      if (cache.enabled() && conn.fileId) {
+         auto block = cache.get(*conn.fileId, chunkIdx / ReadCache::BLOCK_CHUNKS, conn.file->fd);
+         if (block == nullptr) return {};
+
+         const size_t offset = (chunkIdx % ReadCache::BLOCK_CHUNKS) * CHUNK_SIZE;
+         if (offset >= block->data.size()) return {};
+         const size_t size = std::min<size_t>(CHUNK_SIZE, block->data.size() - offset);
+         return {block, {block->data.data() + offset, size}};
+      }
 
-            msgOut << PAYLOAD;
-            msgOut << connectionId;
-            msgOut << conn.window.id;
-            msgOut << conn.window.currentSize;
-            msgOut << i;
-            msgOut << conn.window.chunks[i];
+      return {nullptr, {buffer, conn.file->read(chunkIdx * CHUNK_SIZE, buffer, CHUNK_SIZE)}};
+   }
+   // ------------------------------------------------------------------------
+   void Server::send_payload(Message<ServerMsgType>& msgOut, ConnectionID connectionId, const Connection& conn, uint16_t i, const Chunk& chunk,
+                             const ip::udp::endpoint& client)
+   {
+      if (!link.zerocopy() || chunk.block == nullptr) {
+         wire::Payload::encode(msgOut, PAYLOAD, connectionId, conn.window.id, conn.window.currentSize, i, chunk.data);
+         send_msg_to_client(msgOut, client);
+         return;
+      }
 
-            conn.timer.setTimeout(minutes(TIMEOUT), boost::bind(&Server::handle_timeout, this, connectionId));
+      // only the header is written, the chunk is sent from its block, which the link holds until the kernel sent it
+      wire::Payload::encode(msgOut, PAYLOAD, connectionId, conn.window.id, conn.window.currentSize, i);
+      const size_t size = msgOut.header.size + chunk.data.size();
+      ++counters.packetsSent;
+      counters.bytesSent += size;
+      if (trace::enabled()) {
+         wire::append(msgOut, chunk.data);
+         trace::packet(trace::Source::SERVER, trace::EventType::PACKET_SENT, msgOut.packet, size);
+      }
 
-            send_msg_to_client(msgOut, msg.header.remote);
+      // sent on the strand of the socket, the header is copied, the block keeps the chunk alive
+      std::array<unsigned char, PAYLOAD_META_DATA_SIZE> header;
+      std::memcpy(header.data(), msgOut.packet, header.size());
+      dispatch(socket.get_executor(), [this, header, data = chunk.data, block = chunk.block, client]() {
+         link.send(header, data, block, client, [this](const boost::system::error_code& error, size_t bytes_transferred) { handle_send(error, bytes_transferred); });
+      });
+   }
+   // ------------------------------------------------------------------------
+   void Server::read_ahead(Connection& conn, uint32_t limit)
+   {
+      // the next request usually starts behind the current window, the window grows by less than its size per RTT
+      const uint64_t fileChunks = (conn.fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+      const uint64_t next = static_cast<uint64_t>(conn.window.chunkIdx) + conn.window.currentSize;
+      uint64_t end = std::min<uint64_t>(fileChunks, next + READ_AHEAD_WINDOWS * conn.window.currentSize);
+      if (limit > 0) {
+         end = std::min<uint64_t>(end, static_cast<uint64_t>(conn.window.chunkIdx) + limit);
+      }
+      const uint64_t first = std::max(next, conn.readAhead);
+      if (first >= end) return;
+      conn.readAhead = end;
+      counters.chunksReadAhead += end - first;
+
+      // the task holds the file, the connection may be gone once it runs
+      if (cache.enabled() && conn.fileId) {
+         post(readers, [this, file = conn.file, fileId = *conn.fileId, first, end]() {
+            for (uint64_t block = first / ReadCache::BLOCK_CHUNKS; block <= (end - 1) / ReadCache::BLOCK_CHUNKS; ++block) {
+               cache.get(fileId, block, file->fd);
+            }
+         });
+      } else {
+         post(readers, [file = conn.file, first, end]() {
+            posix_fadvise(file->fd, static_cast<off_t>(first * CHUNK_SIZE), static_cast<off_t>((end - first) * CHUNK_SIZE), POSIX_FADV_WILLNEED);
+         });
+      }
+   }
+   // ------------------------------------------------------------------------
+   std::shared_ptr<const ReadCache::FileId> Server::count_transfer(const ReadCache::FileId& file)
+   {
+      std::unique_lock lock(transfersMux);
+
+      auto search = transfers.find(file);
+      if (search != transfers.end()) {
+         if (auto token = search->second.lock()) return token;
+      }
+
+      // tokens vanish with their last connection
+      std::erase_if(transfers, [](const auto& entry) { return entry.second.expired(); });
+
+      auto token = std::make_shared<const ReadCache::FileId>(file);
+      transfers[file] = token;
+      return token;
+   }
+   // ------------------------------------------------------------------------
+   bool Server::is_shared(const Connection& conn) const
+   {
+      return cache.enabled() && conn.fileId && conn.transfers.use_count() > 1;
+   }
+   // ------------------------------------------------------------------------
+   void Server::send_shared(Connection& conn, ConnectionID connectionId, uint16_t first, uint16_t count, const ip::udp::endpoint& client)
+   {
+      // chunks of a batch never span two blocks
+      const uint64_t chunk = static_cast<uint64_t>(conn.window.chunkIdx) + first;
+      auto block = cache.get(*conn.fileId, chunk / ReadCache::BLOCK_CHUNKS, conn.file->fd);
+      if (block == nullptr) return;
+
+      post(workers, boost::bind(&Server::send_block, this, connectionId, conn.window.id, conn.window.currentSize, first, count,
+                       block, static_cast<uint16_t>(chunk % ReadCache::BLOCK_CHUNKS), client));
+   }
+   // ------------------------------------------------------------------------
+   void Server::send_block(ConnectionID connectionId, uint8_t windowId, uint16_t windowSize, uint16_t first, uint16_t count,
+                           const std::shared_ptr<const ReadCache::Block>& block, uint16_t offset, const ip::udp::endpoint& client)
+   {
+      for (uint16_t k = 0; k < count; ++k) {
+         const size_t pos = static_cast<size_t>(offset + k) * CHUNK_SIZE;
+         if (pos >= block->data.size()) return;
+
+         const auto& compressed = block->compressed(offset + k);
+         const uint16_t i = first + k;
+         const auto type = compressed.empty() ? PAYLOAD : COMPRESSED_PAYLOAD;
+
+         // only the header is written per connection, into the packet that the send owns
+         auto msgOut = std::make_shared<Message<ServerMsgType>>();
+         if (compressed.empty()) {
+            const size_t size = std::min<size_t>(CHUNK_SIZE, block->data.size() - pos);
+            wire::Payload::encode(*msgOut, type, connectionId, windowId, windowSize, i, {&block->data[pos], size});
+         } else {
+            wire::Payload::encode(*msgOut, type, connectionId, windowId, windowSize, i, compressed);
          }
+
+         send_msg_to_client(std::move(msgOut), client);
+      }
+   }
+   // ------------------------------------------------------------------------
+   void Server::send_compressed(ConnectionID connectionId, uint8_t windowId, uint16_t windowSize, uint16_t first, uint16_t count,
+                                const std::vector<unsigned char>& chunks, const ip::udp::endpoint& client)
+   {
+      size_t offset = 0;
+      uint16_t i = first;
+      while (i < first + count) {
+         const size_t chunkSize = std::min<size_t>(CHUNK_SIZE, chunks.size() - offset);
+
+         // encoded in place into the packet that is sent, which the send owns
+         auto msgOut = std::make_shared<Message<ServerMsgType>>();
+         wire::Payload::encode(*msgOut, COMPRESSED_PAYLOAD, connectionId, windowId, windowSize, i);
+
+         // incompressible data is detected before spending time on it
+         size_t compressedSize = 0;
+         size_t consumed = 0;
+         if (lz::is_compressible(chunks.data() + offset, chunkSize)) {
+            consumed = lz::compress_chunks(chunks.data() + offset, chunks.size() - offset, &msgOut->packet[msgOut->header.size], CHUNK_SIZE, compressedSize);
+         }
+
+         // a single chunk is only sent compressed if that saves a noticeable part of it
+         if (consumed > chunkSize || (consumed == chunkSize && compressedSize < chunkSize * 7 / 8)) {
+            msgOut->header.size += compressedSize;
+            send_msg_to_client(std::move(msgOut), client);
+
+            offset += consumed;
+            i += (consumed + CHUNK_SIZE - 1) / CHUNK_SIZE;
+            continue;
+         }
+
+         wire::Payload::encode(*msgOut, PAYLOAD, connectionId, windowId, windowSize, i, {chunks.data() + offset, chunkSize});
+         send_msg_to_client(std::move(msgOut), client);
+
+         offset += chunkSize;
+         ++i;
       }
    }
    // ------------------------------------------------------------------------
    void Server::handle_timeout(ConnectionID connectionId)
    {
       auto search = connections.find(connectionId);
-      if (search != connections.end()) {
-         auto& conn = search->second;
+      if (search != nullptr) {
+         auto& conn = *search;
          if (conn.timer.isExpired()) {
             PLOG_INFO << "Timeout expired for: " << connectionId;
+            if (trace::enabled()) trace::record(trace::Source::SERVER, trace::EventType::TIMEOUT, connectionId, trace::CONNECTION_TIMEOUT);
             connections.erase(connectionId);
+            ++counters.timeouts;
+            ++counters.connectionsClosed;
          }
       }
    }
    // ------------------------------------------------------------------------
+   void Server::export_metrics()
+   {
+      Exposition page("role=\"server\"");
+
+      page.counter("rft_packets_sent_total", "Packets sent, including those the emulated link drops", counters.packetsSent);
+      page.counter("rft_bytes_sent_total", "Bytes of the packets sent", counters.bytesSent);
+      page.counter("rft_packets_received_total", "Packets received", counters.packetsReceived);
+      page.counter("rft_bytes_received_total", "Bytes of the packets received", counters.bytesReceived);
+      page.counter("rft_chunks_sent_total", "Chunks sent with the first transmission of their window", counters.chunksSent);
+      page.counter("rft_chunks_retransmitted_total", "Chunks sent again after a Retransmission Request", counters.chunksRetransmitted);
+      page.counter("rft_chunks_read_ahead_total", "Chunks read in the background ahead of the Transmission Request for them", counters.chunksReadAhead);
+      if (link.zerocopy()) {
+         const auto zeroCopy = link.zerocopy_stats();
+         page.counter("rft_zerocopy_sends_total", "Payloads sent without copying them into the socket buffer", zeroCopy.sent);
+         page.counter("rft_zerocopy_copied_total", "Zero-copy sends the kernel copied nevertheless, e.g., over the loopback device", zeroCopy.copied);
+         page.counter("rft_zerocopy_refused_total", "Payloads copied because the kernel did not pin them, e.g., beyond optmem_max", zeroCopy.refused);
+      }
+      page.counter("rft_transmission_requests_total", "Transmission Requests for known connections", counters.transmissionRequests);
+      page.counter("rft_retransmission_requests_total", "Retransmission Requests for known connections", counters.retransmissionRequests);
+      page.counter("rft_phase_changes_total", "Changes of the congestion control phase", counters.phaseChanges);
+      page.counter("rft_timeouts_total", "Connections closed because the client went silent", counters.timeouts);
+      page.counter("rft_connections_opened_total", "Connections opened after a successful validation", counters.connectionsOpened);
+      page.counter("rft_connections_closed_total", "Connections closed by a Finish message or a timeout", counters.connectionsClosed);
+      page.gauge("rft_connections", "Open connections", static_cast<double>(connections.size()));
+      page.gauge("rft_message_queue_depth", "Received messages waiting to be processed", static_cast<double>(msgQueue.count()));
+      page.gauge("rft_open_files", "Served files kept open between connections", static_cast<double>(files.size()));
+      page.gauge("rft_pending_validations", "Client Validation Responses waiting for a worker thread", static_cast<double>(pendingValidations));
+      page.histogram("rft_server_handshake_processing_seconds", "Time the server spends from a Client Validation Response until its Server Initial Response", handshakeProcessing);
+
+      struct Sample {
+         std::string labels;
+         const Connection* conn;
+      };
+      std::vector<Sample> samples;
+      connections.for_each([&](ConnectionID connectionId, const Connection& conn) {
+         samples.push_back({"connection=\"" + std::to_string(connectionId) + "\",peer=\"" + conn.client.address().to_string() + ":" + std::to_string(conn.client.port()) + "\"", &conn});
+      });
+
+      // connections are only erased on this thread, hence the pointers stay valid
+      auto perConnection = [&](const std::string& name, const std::string& type, const std::string& help, auto value) {
+         page.family(name, type, help);
+         for (auto& sample: samples) {
+            page.sample(name, sample.labels, static_cast<double>(value(*sample.conn)));
+         }
+      };
+      perConnection("rft_connection_cwnd", "gauge", "Congestion window in chunks", [](const Connection& conn) { return conn.cc.cwnd; });
+      perConnection("rft_connection_window_chunks", "gauge", "Size of the current window in chunks", [](const Connection& conn) { return conn.window.currentSize; });
+      perConnection("rft_connection_rtt_current_microseconds", "gauge", "Last RTT reported by the client", [](const Connection& conn) { return conn.cc.rttCurrent; });
+      perConnection("rft_connection_rtt_max_microseconds", "gauge", "Largest RTT reported by the client", [](const Connection& conn) { return conn.cc.rttMax; });
+      perConnection("rft_connection_congestion_avoidance", "gauge", "Whether the congestion control is in the avoidance phase", [](const Connection& conn) {
+         return conn.cc.phase == CongestionControl::Phase::CC_AVOIDANCE ? 1 : 0;
+      });
+      perConnection("rft_connection_file_bytes", "gauge", "Size of the transferred file", [](const Connection& conn) { return conn.fileSize; });
+      perConnection("rft_connection_chunks_sent_total", "counter", "Chunks sent with the first transmission of their window", [](const Connection& conn) { return conn.chunksSent; });
+      perConnection("rft_connection_chunks_retransmitted_total", "counter", "Chunks sent again after a Retransmission Request", [](const Connection& conn) { return conn.chunksRetransmitted; });
+      perConnection("rft_connection_phase_changes_total", "counter", "Changes of the congestion control phase", [](const Connection& conn) { return conn.phaseChanges; });
+
+      // the file is written off the thread processing the messages
+      post(workers, [path = metricsFile, text = page.str()]() {
+         if (!Exposition::write(path, text)) {
+            PLOG_WARNING << "[Server] Could not write metrics to " << path;
+         }
+      });
+
+      metricsTimer.setTimeout(METRICS_INTERVAL);
+   }
+   // ------------------------------------------------------------------------
 }// namespace rft
 // ------------------------------------------------------------------------
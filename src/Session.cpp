@@ -0,0 +1,35 @@
+// ------------------------------------------------------------------------
+#include "Session.hpp"
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   Transfer::Transfer(io_context& context, const ip::udp::endpoint& server, std::vector<std::string> files, const TransferOptions& options)
+       : client(context, server, options.dest, options.link, options.capabilities, options.useDelta, options.directIo, options.cacheDir, options.metricsFile), done(promise.get_future().share())
+   {
+      client.on_progress(options.onProgress);
+      client.start(std::move(files), [this]() { promise.set_value(TransferResult{client.statistics(), client.isCancelled()}); });
+   }
+   // ------------------------------------------------------------------------
+   Transfer::~Transfer()
+   {
+      // the promise is set on the io_context, before the client waits for its pending operations
+      client.cancel();
+      done.wait();
+   }
+   // ------------------------------------------------------------------------
+   Session::Session(io_context& context, const std::string& host, size_t port) : context(context)
+   {
+      ip::udp::resolver resolver(context);
+      endpoint = *resolver.resolve(ip::udp::v4(), host, std::to_string(port)).begin();
+
+      PLOG_INFO << "[Session] Resolved server at " << endpoint.address().to_string() << ":" << endpoint.port();
+   }
+   // ------------------------------------------------------------------------
+   std::unique_ptr<Transfer> Session::start(std::vector<std::string> files, const TransferOptions& options)
+   {
+      return std::make_unique<Transfer>(context, endpoint, std::move(files), options);
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
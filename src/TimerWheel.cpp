@@ -0,0 +1,202 @@
+// ------------------------------------------------------------------------
+#include "TimerWheel.hpp"
+// ------------------------------------------------------------------------
+namespace rft
+{
+   // ------------------------------------------------------------------------
+   TimerWheel::TimerWheel(micros resolution) : resolution(resolution) {}
+   // ------------------------------------------------------------------------
+   void TimerWheel::schedule(Node& node, clock::time_point deadline, std::function<void()> callback)
+   {
+      std::unique_lock lock(mux);
+      node.callback = std::move(callback);
+      arm(node, deadline);
+   }
+   // ------------------------------------------------------------------------
+   void TimerWheel::reschedule(Node& node, clock::time_point deadline)
+   {
+      std::unique_lock lock(mux);
+      arm(node, deadline);
+   }
+   // ------------------------------------------------------------------------
+   void TimerWheel::cancel(Node& node)
+   {
+      std::unique_lock lock(mux);
+      if (node.list != nullptr) {
+         unlink(node);
+      }
+   }
+   // ------------------------------------------------------------------------
+   bool TimerWheel::isExpired(const Node& node)
+   {
+      std::unique_lock lock(mux);
+      return node.deadline <= clock::now();
+   }
+   // ------------------------------------------------------------------------
+   void TimerWheel::move(Node& from, Node& to)
+   {
+      std::unique_lock lock(mux);
+      to.deadline = from.deadline;
+      to.tick = from.tick;
+      to.callback = std::move(from.callback);
+
+      if (from.list != nullptr) {
+         to.list = from.list;
+         to.prev = from.prev;
+         to.next = from.next;
+         if (to.prev != nullptr) {
+            to.prev->next = &to;
+         } else {
+            *to.list = &to;
+         }
+         if (to.next != nullptr) {
+            to.next->prev = &to;
+         }
+         from.list = nullptr;
+         from.prev = nullptr;
+         from.next = nullptr;
+      }
+   }
+   // ------------------------------------------------------------------------
+   nanos TimerWheel::advance()
+   {
+      std::unique_lock lock(mux);
+
+      auto now = clock::now();
+      uint64_t nowTick = chrono::duration_cast<micros>(now - start).count() / resolution.count();
+
+      if (armed == 0) {
+         currentTick = nowTick;
+      }
+
+      while (currentTick < nowTick) {
+         ++currentTick;
+
+         // move the timers of the higher levels down, starting with the highest level that wrapped around
+         uint8_t level = 1;
+         while (level < LEVELS && (currentTick & ((1ULL << (SLOT_BITS * level)) - 1)) == 0) {
+            ++level;
+         }
+         for (uint8_t l = level - 1; l > 0; --l) {
+            cascade(l);
+         }
+
+         Node* node = slots[0][currentTick & (SLOTS - 1)];
+         while (node != nullptr) {
+            Node* next = node->next;
+            unlink(*node);
+            if (tick_of(node->deadline) <= currentTick) {
+               link(*node, expired);
+            } else {
+               // the timer was re-armed after it had been inserted
+               insert(*node, currentTick + 1);
+            }
+            node = next;
+         }
+      }
+
+      // the callback may re-arm or destroy its own or other timers, hence it is run on a copy without holding the lock
+      while (expired != nullptr) {
+         Node& node = *expired;
+         unlink(node);
+         auto callback = node.callback;
+
+         lock.unlock();
+         if (callback) callback();
+         lock.lock();
+      }
+
+      if (armed == 0) {
+         return IDLE_WAIT;
+      }
+
+      // wake up for the next occupied slot, but at the latest when the higher levels have to be cascaded
+      uint64_t tick = currentTick + 1;
+      while ((tick & (SLOTS - 1)) != 0 && slots[0][tick & (SLOTS - 1)] == nullptr) {
+         ++tick;
+      }
+
+      return std::max(nanos(0), chrono::duration_cast<nanos>(start + tick * resolution - clock::now()));
+   }
+   // ------------------------------------------------------------------------
+   uint64_t TimerWheel::tick_of(clock::time_point tp) const
+   {
+      if (tp <= start) return 0;
+      // round up, a timer must never expire before its deadline
+      uint64_t elapsed = std::chrono::ceil<micros>(tp - start).count();
+      return (elapsed + resolution.count() - 1) / resolution.count();
+   }
+   // ------------------------------------------------------------------------
+   void TimerWheel::arm(Node& node, clock::time_point deadline)
+   {
+      node.deadline = deadline;
+
+      // lazy re-arming: a later deadline is only taken into account once the timer's slot is reached
+      if (node.list != nullptr && node.list != &expired && tick_of(deadline) >= node.tick) return;
+
+      if (node.list != nullptr) {
+         unlink(node);
+      }
+      insert(node, currentTick + 1);
+   }
+   // ------------------------------------------------------------------------
+   void TimerWheel::insert(Node& node, uint64_t earliest)
+   {
+      uint64_t tick = std::max(tick_of(node.deadline), earliest);
+      uint64_t delta = tick - currentTick;
+
+      uint8_t level = 0;
+      while (level < LEVELS - 1 && delta >= (1ULL << (SLOT_BITS * (level + 1)))) {
+         ++level;
+      }
+      if (delta >= (1ULL << (SLOT_BITS * LEVELS))) {
+         // beyond the range of the wheel, the timer is inserted again once the last slot is reached
+         tick = currentTick + (1ULL << (SLOT_BITS * LEVELS)) - 1;
+      }
+
+      node.tick = tick;
+      link(node, slots[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+   }
+   // ------------------------------------------------------------------------
+   void TimerWheel::cascade(uint8_t level)
+   {
+      Node* node = slots[level][(currentTick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+      while (node != nullptr) {
+         Node* next = node->next;
+         unlink(*node);
+         // timers of the current tick go into the slot that is processed next
+         insert(*node, currentTick);
+         node = next;
+      }
+   }
+   // ------------------------------------------------------------------------
+   void TimerWheel::link(Node& node, Node*& list)
+   {
+      node.prev = nullptr;
+      node.next = list;
+      if (list != nullptr) {
+         list->prev = &node;
+      }
+      list = &node;
+      node.list = &list;
+      ++armed;
+   }
+   // ------------------------------------------------------------------------
+   void TimerWheel::unlink(Node& node)
+   {
+      if (node.prev != nullptr) {
+         node.prev->next = node.next;
+      } else {
+         *node.list = node.next;
+      }
+      if (node.next != nullptr) {
+         node.next->prev = node.prev;
+      }
+      node.prev = nullptr;
+      node.next = nullptr;
+      node.list = nullptr;
+      --armed;
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft
+// ------------------------------------------------------------------------
@@ -0,0 +1,161 @@
+// ------------------------------------------------------------------------
+#include "Trace.hpp"
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+// ------------------------------------------------------------------------
+namespace rft::trace
+{
+   // ------------------------------------------------------------------------
+   namespace
+   {
+      /// Single producer (the recording thread), single consumer (the flushing thread)
+      struct Ring {
+         static constexpr uint32_t CAPACITY = 1 << 14;
+
+         std::array<Event, CAPACITY> events;
+         std::atomic<uint64_t> head = 0;
+         std::atomic<uint64_t> tail = 0;
+      };
+
+      /// How often the rings are written to the file, a ring holds about 16k events
+      constexpr millis FLUSH_INTERVAL = millis(20);
+
+      std::mutex mux;
+      std::condition_variable cv;
+      bool stopping = false;
+      std::ofstream file;
+      std::thread flusher;
+      std::chrono::steady_clock::time_point start;
+      /// Rings of all threads that recorded since the trace was opened
+      std::vector<std::shared_ptr<Ring>> rings;
+      /// Increased whenever a trace is opened, so that threads register new rings
+      std::atomic<uint64_t> epoch = 0;
+      std::atomic<uint64_t> droppedEvents = 0;
+
+      thread_local std::shared_ptr<Ring> localRing;
+      thread_local uint64_t localEpoch = 0;
+
+      Ring& ring()
+      {
+         const uint64_t current = epoch.load(std::memory_order_acquire);
+         if (localRing == nullptr || localEpoch != current) {
+            localRing = std::make_shared<Ring>();
+            localEpoch = current;
+            std::unique_lock lock(mux);
+            rings.push_back(localRing);
+         }
+         return *localRing;
+      }
+
+      void push(const Event& event)
+      {
+         Ring& r = ring();
+         const uint64_t head = r.head.load(std::memory_order_relaxed);
+         if (head - r.tail.load(std::memory_order_acquire) == Ring::CAPACITY) {
+            droppedEvents.fetch_add(1, std::memory_order_relaxed);
+            return;
+         }
+         r.events[head % Ring::CAPACITY] = event;
+         r.head.store(head + 1, std::memory_order_release);
+      }
+
+      uint64_t now()
+      {
+         return chrono::duration_cast<nanos>(std::chrono::steady_clock::now() - start).count();
+      }
+
+      /// Appends the events of all rings to the file, called with the lock held
+      void drain()
+      {
+         for (auto& r: rings) {
+            const uint64_t tail = r->tail.load(std::memory_order_relaxed);
+            const uint64_t head = r->head.load(std::memory_order_acquire);
+            for (uint64_t i = tail; i < head; ++i) {
+               file.write(reinterpret_cast<const char*>(&r->events[i % Ring::CAPACITY]), sizeof(Event));
+            }
+            r->tail.store(head, std::memory_order_release);
+         }
+         file.flush();
+      }
+
+      void flush_periodically()
+      {
+         std::unique_lock lock(mux);
+         while (!stopping) {
+            cv.wait_for(lock, FLUSH_INTERVAL, []() { return stopping; });
+            drain();
+         }
+      }
+   }// namespace
+   // ------------------------------------------------------------------------
+   std::atomic<bool> active = false;
+   // ------------------------------------------------------------------------
+   bool open(const std::string& path)
+   {
+      close();
+
+      std::unique_lock lock(mux);
+      file.open(path, std::ios::binary | std::ios::trunc);
+      if (!file) return false;
+
+      FileHeader header{};
+      std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+      header.version = VERSION;
+      header.eventSize = sizeof(Event);
+      header.start = chrono::duration_cast<nanos>(std::chrono::system_clock::now().time_since_epoch()).count();
+      file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+      start = std::chrono::steady_clock::now();
+      rings.clear();
+      droppedEvents = 0;
+      stopping = false;
+      epoch.fetch_add(1, std::memory_order_release);
+      flusher = std::thread(flush_periodically);
+      active = true;
+      return true;
+   }
+   // ------------------------------------------------------------------------
+   void close()
+   {
+      active = false;
+      {
+         std::unique_lock lock(mux);
+         stopping = true;
+      }
+      cv.notify_all();
+      if (flusher.joinable()) flusher.join();
+
+      std::unique_lock lock(mux);
+      if (file.is_open()) {
+         drain();
+         file.close();
+      }
+      rings.clear();
+   }
+   // ------------------------------------------------------------------------
+   uint64_t dropped()
+   {
+      return droppedEvents.load(std::memory_order_relaxed);
+   }
+   // ------------------------------------------------------------------------
+   void record(Source source, EventType type, ConnectionID connection, uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+   {
+      push(Event{now(), type, source, 0, connection, {a, b, c, d}});
+   }
+   // ------------------------------------------------------------------------
+   void packet(Source source, EventType type, const unsigned char* packet, size_t size)
+   {
+      Event event{now(), type, source, static_cast<uint16_t>(size), 0, {}};
+      std::memcpy(event.values, packet, std::min(size, sizeof(event.values)));
+      push(event);
+   }
+   // ------------------------------------------------------------------------
+}// namespace rft::trace
+// ------------------------------------------------------------------------
@@ -1,7 +1,10 @@
 // ------------------------------------------------------------------------
 #include "util.hpp"
 #include "sha256.h"
+#include <cerrno>
 #include <fstream>
+#include <unistd.h>
+#include <vector>
 // ------------------------------------------------------------------------
 namespace rft
 {
@@ -27,6 +30,33 @@ namespace rft
       sha256.getHash(ret);
    }
    // ------------------------------------------------------------------------
+   void compute_file_SHA256(int fd, unsigned char ret[SHA256_SIZE])
+   {
+      const size_t BufferSize = 144 * 7 * 1024;
+      std::vector<char> buffer(BufferSize);
+      SHA256 sha256;
+
+      uint64_t offset = 0;
+      while (size_t numBytesRead = read_at(fd, offset, buffer.data(), BufferSize)) {
+         sha256.add(buffer.data(), numBytesRead);
+         offset += numBytesRead;
+      }
+
+      sha256.getHash(ret);
+   }
+   // ------------------------------------------------------------------------
+   size_t read_at(int fd, uint64_t offset, void* buffer, size_t size)
+   {
+      size_t total = 0;
+      while (total < size) {
+         ssize_t n = pread(fd, static_cast<char*>(buffer) + total, size - total, static_cast<off_t>(offset + total));
+         if (n < 0 && errno == EINTR) continue;
+         if (n <= 0) break;
+         total += n;
+      }
+      return total;
+   }
+   // ------------------------------------------------------------------------
    void compute_SHA256(unsigned char* buffer, size_t size, unsigned char ret[SHA256_SIZE])
    {
       SHA256 sha256;
@@ -64,13 +94,5 @@ namespace rft
       }
    }
    // ------------------------------------------------------------------------
-   double random()
-   {
-      static std::random_device rd;
-      static std::default_random_engine eng(rd());
-      static std::uniform_real_distribution<double> dist(0, 1);
-      return dist(eng);
-   }
-   // ------------------------------------------------------------------------
 }// namespace rft
 // ------------------------------------------------------------------------
@@ -0,0 +1,256 @@
+// ------------------------------------------------------------------------
+// Converts a binary trace (c.f. Trace.hpp) into qlog or a CSV time series,
+// e.g., to plot the cwnd and the RTT of every connection.
+// ------------------------------------------------------------------------
+#include "Message.hpp"
+#include "Trace.hpp"
+#include <algorithm>
+#include <boost/program_options.hpp>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <vector>
+// ------------------------------------------------------------------------
+namespace po = boost::program_options;
+using namespace std;
+using namespace rft;
+// ------------------------------------------------------------------------
+/// Header of a traced packet, as far as the first 16 bytes tell
+struct PacketInfo {
+   string type;
+   optional<ConnectionID> connection;
+};
+// ------------------------------------------------------------------------
+static bool sent_by_server(const trace::Event& event)
+{
+   return (event.source == trace::Source::SERVER) == (event.type == trace::EventType::PACKET_SENT);
+}
+// ------------------------------------------------------------------------
+static PacketInfo decode_packet(const trace::Event& event)
+{
+   unsigned char bytes[sizeof(event.values)];
+   std::memcpy(bytes, event.values, sizeof(bytes));
+
+   // the message types carrying a connection have its ID right after the type
+   ConnectionID connectionId;
+   std::memcpy(&connectionId, bytes + 1, sizeof(connectionId));
+   connectionId = ntoh(connectionId);
+
+   if (sent_by_server(event)) {
+      switch (static_cast<ServerMsgType>(bytes[0])) {
+         case SERVER_VALIDATION_REQUEST: return {"SERVER_VALIDATION_REQUEST", nullopt};
+         case SERVER_INITIAL_RESPONSE: return {"SERVER_INITIAL_RESPONSE", connectionId};
+         case PAYLOAD: return {"PAYLOAD", connectionId};
+         case PARITY_PAYLOAD: return {"PARITY_PAYLOAD", connectionId};
+         case COMPRESSED_PAYLOAD: return {"COMPRESSED_PAYLOAD", connectionId};
+         case SERVER_MANIFEST_RESPONSE: return {"SERVER_MANIFEST_RESPONSE", connectionId};
+         case ERROR_FILE_NOT_FOUND: return {"ERROR_FILE_NOT_FOUND", nullopt};
+         case ERROR_CLIENT_VALIDATION_FAILED: return {"ERROR_CLIENT_VALIDATION_FAILED", nullopt};
+         case ERROR_CONNECTION_NOT_FOUND: return {"ERROR_CONNECTION_NOT_FOUND", connectionId};
+      }
+   } else {
+      switch (static_cast<ClientMsgType>(bytes[0])) {
+         case FILE_REQUEST: return {"FILE_REQUEST", nullopt};
+         case CLIENT_VALIDATION_RESPONSE: return {"CLIENT_VALIDATION_RESPONSE", nullopt};
+         case TRANSMISSION_REQUEST: return {"TRANSMISSION_REQUEST", connectionId};
+         case RETRANSMISSION_REQUEST: return {"RETRANSMISSION_REQUEST", connectionId};
+         case CLIENT_FINISH_MESSAGE: return {"CLIENT_FINISH_MESSAGE", connectionId};
+         case ERROR_CONNECTION_TERMINATION: return {"ERROR_CONNECTION_TERMINATION", nullopt};
+      }
+   }
+   return {"UNKNOWN", nullopt};
+}
+// ------------------------------------------------------------------------
+static const char* timeout_name(uint32_t timeout)
+{
+   switch (timeout) {
+      case trace::TRANSMISSION_TIMEOUT: return "transmission";
+      case trace::RETRANSMISSION_TIMEOUT: return "retransmission";
+      case trace::FILE_REQUEST_TIMEOUT: return "file_request";
+      case trace::CONNECTION_TIMEOUT: return "connection";
+      default: return "unknown";
+   }
+}
+// ------------------------------------------------------------------------
+static double millis_of(uint64_t nanoseconds)
+{
+   return static_cast<double>(nanoseconds) / 1e6;
+}
+// ------------------------------------------------------------------------
+static void write_csv(ostream& out, const vector<trace::Event>& events)
+{
+   out << "time_ms,source,event,connection,packet_type,size,first_chunk,chunks,chunks_transmitted,cwnd,rtt_us,rtt_max_us,phase,srtt_us,rto_us,timeout\n";
+   for (const auto& e: events) {
+      out << millis_of(e.time) << "," << (e.source == trace::Source::SERVER ? "server" : "client") << ",";
+      const auto& v = e.values;
+      switch (e.type) {
+         case trace::EventType::PACKET_SENT:
+         case trace::EventType::PACKET_RECEIVED: {
+            auto info = decode_packet(e);
+            out << (e.type == trace::EventType::PACKET_SENT ? "packet_sent" : "packet_received") << ","
+                << (info.connection ? to_string(*info.connection) : "") << "," << info.type << "," << e.size << ",,,,,,,,,,\n";
+            break;
+         }
+         case trace::EventType::WINDOW_STARTED:
+            out << "window_started," << e.connection << ",,," << v[0] << "," << v[1] << ",,,,,,,,\n";
+            break;
+         case trace::EventType::WINDOW_COMPLETED:
+            out << "window_completed," << e.connection << ",,,," << v[0] << "," << v[1] << ",,,,,,,\n";
+            break;
+         case trace::EventType::CC_DECISION:
+            out << "cc_decision," << e.connection << ",,,,,," << v[0] << "," << v[1] << "," << v[2] << "," << (v[3] == 0 ? "normal" : "avoidance") << ",,,\n";
+            break;
+         case trace::EventType::RTT_SAMPLE:
+            out << "rtt_sample," << e.connection << ",,,,,,,,,," << v[0] << "," << v[1] << ",\n";
+            break;
+         case trace::EventType::RETRANSMISSION:
+            out << "retransmission," << e.connection << ",,,," << v[0] << ",,,,,,,,\n";
+            break;
+         case trace::EventType::TIMEOUT:
+            out << "timeout," << e.connection << ",,,,,,,,,,,," << timeout_name(v[0]) << "\n";
+            break;
+         default:
+            out << "unknown," << e.connection << ",,,,,,,,,,,,\n";
+            break;
+      }
+   }
+}
+// ------------------------------------------------------------------------
+static void write_qlog_event(ostream& out, const trace::Event& e)
+{
+   const auto& v = e.values;
+   out << "        {\"time\": " << millis_of(e.time) << ", ";
+   switch (e.type) {
+      case trace::EventType::PACKET_SENT:
+      case trace::EventType::PACKET_RECEIVED: {
+         auto info = decode_packet(e);
+         out << "\"name\": \"transport:" << (e.type == trace::EventType::PACKET_SENT ? "packet_sent" : "packet_received")
+             << "\", \"data\": {\"header\": {\"packet_type\": \"" << info.type << "\"";
+         if (info.connection) out << ", \"connection\": " << *info.connection;
+         out << "}, \"raw\": {\"length\": " << e.size << "}}}";
+         break;
+      }
+      case trace::EventType::WINDOW_STARTED:
+         out << "\"name\": \"rft:window_started\", \"data\": {\"connection\": " << e.connection << ", \"first_chunk\": " << v[0] << ", \"chunks\": " << v[1] << "}}";
+         break;
+      case trace::EventType::WINDOW_COMPLETED:
+         out << "\"name\": \"rft:window_completed\", \"data\": {\"connection\": " << e.connection << ", \"chunks\": " << v[0] << ", \"chunks_transmitted\": " << v[1] << "}}";
+         break;
+      case trace::EventType::CC_DECISION:
+         out << "\"name\": \"recovery:metrics_updated\", \"data\": {\"connection\": " << e.connection << ", \"congestion_window\": " << v[0]
+             << ", \"latest_rtt\": " << v[1] / 1000.0 << ", \"max_rtt\": " << v[2] / 1000.0 << ", \"phase\": \"" << (v[3] == 0 ? "normal" : "avoidance") << "\"}}";
+         break;
+      case trace::EventType::RTT_SAMPLE:
+         out << "\"name\": \"recovery:metrics_updated\", \"data\": {\"connection\": " << e.connection << ", \"smoothed_rtt\": " << v[0] / 1000.0
+             << ", \"rto\": " << v[1] / 1000.0 << "}}";
+         break;
+      case trace::EventType::RETRANSMISSION:
+         out << "\"name\": \"rft:retransmission\", \"data\": {\"connection\": " << e.connection << ", \"chunks\": " << v[0] << "}}";
+         break;
+      case trace::EventType::TIMEOUT:
+         out << "\"name\": \"rft:timeout\", \"data\": {\"connection\": " << e.connection << ", \"timeout\": \"" << timeout_name(v[0]) << "\"}}";
+         break;
+      default:
+         out << "\"name\": \"rft:unknown\", \"data\": {}}";
+         break;
+   }
+}
+// ------------------------------------------------------------------------
+static void write_qlog(ostream& out, const vector<trace::Event>& events, const trace::FileHeader& header)
+{
+   out << "{\n  \"qlog_version\": \"0.3\",\n  \"qlog_format\": \"JSON\",\n  \"title\": \"rft trace\",\n  \"traces\": [\n";
+   bool firstTrace = true;
+   for (auto source: {trace::Source::SERVER, trace::Source::CLIENT}) {
+      if (none_of(events.begin(), events.end(), [&](const auto& e) { return e.source == source; })) continue;
+
+      out << (firstTrace ? "" : ",\n") << "    {\"vantage_point\": {\"type\": \"" << (source == trace::Source::SERVER ? "server" : "client") << "\"},\n"
+          << "     \"common_fields\": {\"time_format\": \"relative\", \"reference_time\": " << millis_of(header.start) << "},\n"
+          << "     \"events\": [\n";
+      bool firstEvent = true;
+      for (const auto& e: events) {
+         if (e.source != source) continue;
+         out << (firstEvent ? "" : ",\n");
+         write_qlog_event(out, e);
+         firstEvent = false;
+      }
+      out << "\n     ]}";
+      firstTrace = false;
+   }
+   out << "\n  ]\n}\n";
+}
+// ------------------------------------------------------------------------
+int main(int argc, char* argv[])
+{
+   string input;
+   string format;
+   string output;
+
+   po::options_description desc{"Usage"};
+   // clang-format off
+   desc.add_options()
+      ("help,h", "produce help message")
+      ("trace", po::value(&input), "binary trace written with --trace")
+      ("format", po::value(&format)->default_value("csv"), "qlog or csv")
+      ("output,o", po::value(&output), "file to write to instead of stdout");
+   // clang-format on
+   po::positional_options_description positionals;
+   positionals.add("trace", 1);
+
+   po::variables_map vm;
+   try {
+      po::store(po::command_line_parser(argc, argv).options(desc).positional(positionals).run(), vm);
+      po::notify(vm);
+   } catch (const exception& ex) {
+      cerr << ex.what() << endl;
+      return 1;
+   }
+   if (vm.count("help") || input.empty()) {
+      cout << desc << endl;
+      return vm.count("help") ? 0 : 1;
+   }
+   if (format != "qlog" && format != "csv") {
+      cerr << "Unknown format: " << format << endl;
+      return 1;
+   }
+
+   ifstream in(input, ios::binary);
+   trace::FileHeader header{};
+   in.read(reinterpret_cast<char*>(&header), sizeof(header));
+   if (!in || std::memcmp(header.magic, trace::MAGIC, sizeof(trace::MAGIC)) != 0) {
+      cerr << input << " is not a trace" << endl;
+      return 1;
+   }
+   if (header.version != trace::VERSION || header.eventSize != sizeof(trace::Event)) {
+      cerr << input << " has version " << header.version << ", only version " << trace::VERSION << " is supported" << endl;
+      return 1;
+   }
+
+   vector<trace::Event> events;
+   trace::Event event{};
+   while (in.read(reinterpret_cast<char*>(&event), sizeof(event))) {
+      events.push_back(event);
+   }
+   // the rings of the threads are flushed one after another
+   stable_sort(events.begin(), events.end(), [](const auto& a, const auto& b) { return a.time < b.time; });
+
+   ofstream file;
+   if (!output.empty()) {
+      file.open(output, ios::trunc);
+      if (!file) {
+         cerr << "Could not open " << output << endl;
+         return 1;
+      }
+   }
+   ostream& out = output.empty() ? cout : file;
+   out << setprecision(9);
+
+   if (format == "qlog") {
+      write_qlog(out, events, header);
+   } else {
+      write_csv(out, events);
+   }
+   return 0;
+}
+// ------------------------------------------------------------------------